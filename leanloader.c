@@ -1,5 +1,12 @@
 #include "submodules/getprocaddress/getprocaddress.c"
-#define _LEANLOADER_DEBUG 0
+#if defined(__SSE2__)
+#include <immintrin.h>
+#include <cpuid.h>
+#endif
+// build with -DLEANLOADER_STATS=1 for the counters behind leanloader_get_stats
+#ifndef LEANLOADER_STATS
+#define LEANLOADER_STATS 0
+#endif
 /*
     leanloader.c
     a simple and efficient single-file image loader library
@@ -11,35 +18,293 @@
     getprocaddress.c from the submodules directory, which is a no-dependency library
     used internally, to make the dependency-free claim possible.
 
-    Tested on Windows 10 with gcc 13.2; ymmv. Not inherently multi-thread-safe.
+    Tested on Windows 10 with gcc 13.2; ymmv. Thread-safe: any number of threads can load
+    and dispose images at the same time, as long as each uses its own leanloader_image_info.
 
     Include this file in your project. It should be pretty friction-free. 
+
+    There's no need to build with -march=native (or any -m flag) for the SIMD paths: every
+    kernel is compiled for each instruction set it has a version for, through target
+    attributes, and the best one the CPU and OS support (SSE2, AVX2 or AVX-512) is picked
+    at run time, so a plain x86-64 build runs well on anything from the oldest x64 CPU on.
     
-    Instantiate the leanloader_image_info struct, set the name field to the name
-    of the image file you want to load (16-bit unicode string) and call leanloader_load.
+    Instantiate the leanloader_image_info struct (zero-initialized), set the name field
+    to the name of the image file you want to load (16-bit unicode string) and call
+    leanloader_load.
 
     Upon return with a nonzero value, the fields of the struct will describe the image.
 
+    To decode an image that's already in memory (say, a memory-mapped archive), call
+    leanloader_load_memory with a pointer to the file's bytes instead.
+
+    To have the pixels written straight into memory of your own (an upload heap, say),
+    point dst at it and set dststride and dstsize; the load fails if the image doesn't fit.
+    Such a buffer is of course not padded the way ours are. leanloader_load_into does the
+    same for a mapped texture or upload heap with its own row pitch (D3D12 wants multiples of
+    256, for one): the rows go straight in, GDI+'s included, and it is only ever written to,
+    in order, since such memory is usually write-combined. (The mip chain, if asked for, is
+    the exception.) Alternatively, install
+    allocator hooks with leanloader_set_allocator to have our buffers come from your heap.
+
+    leanloader_load_rect loads a single region of an image, and leanloader_tiles_open/next/close
+    walk one tile by tile through a single reusable tile buffer; either way only the pixels
+    asked for are converted, and the full image is never allocated. PNGs are still inflated
+    from the top down to the last row needed.
+
+    leanloader_load_rows streams the whole image through a callback a band of rows at a
+    time instead, for pipelines (thumbnailers, say) that never need all of it at once.
+
+    leanloader_load_scaled resizes while decoding (box, bilinear or lanczos3, separable,
+    on premultiplied floats, with SIMD kernels picked at run time), so a thumbnail never
+    costs a full size buffer.
+
+    Animated GIFs and multi-page TIFFs: leanloader_frame_count says how many frames there
+    are, and leanloader_load_frames decodes any run of them (with their delays) into one
+    strip, top to bottom, out of a single GDI+ bitmap rather than reopening the file.
+
+    If all you need is the size, leanloader_probe reads it (and the pixel format) from the
+    file header without decoding anything or allocating a pixel buffer.
+
+    Set LEANLOADER_DETACHED in the flags field to have the GDI+ bitmap released as soon
+    as the pixels are copied out; the struct then owns nothing but the pixel buffer.
+
+    Uncompressed 32bpp .bmp files are parsed natively and never touch GDI+. With
+    LEANLOADER_MAPPED set, a top-down BMP whose pixels need no fixup is not even copied:
+    bd.ptr points straight into a copy-on-write view of the file. Such a pointer is not
+    necessarily 16-byte aligned. LEANLOADER_NO_NATIVE forces everything through GDI+.
+
+    PNGs are decoded natively too, including palette, gray and 16-bit images. Interlaced
+    files, and ones with a gamma other than 1/2.2, are left to GDI+, as is anything else
+    we don't recognize. The unfilters and swizzles have SSE2, AVX2 and AVX-512 versions.
+
+    LEANLOADER_PARALLEL spreads a big PNG (4MB of rows or more) over the processors. The
+    inflating moves to other threads and the rows are unfiltered and converted on the
+    calling one as the data comes in. Files written with full flush points between pieces
+    of the stream can also have those pieces inflated side by side; parallel encoders
+    write such files. A plain stream still gets the two-stage pipeline. Either way the
+    pixels are exactly what the serial decoder produces.
+
+    The pixels come out as 32bpp ARGB unless the format field asks for something else:
+    LEANLOADER_FORMAT_PARGB (premultiplied), _RGB24, _GRAY8 or _ARGB64 (the latter only
+    through GDI+). The conversion happens in the same pass that produces the pixels.
+
+    With LEANLOADER_MIPMAPS set, the full mip chain down to 1x1 is built into the same
+    allocation as the image, each level 64-byte aligned, while the rows it's made from are
+    still in cache. The mip table in the struct gives each level's offset from bd.ptr, size
+    and dimensions. LEANLOADER_MIPMAPS_SRGB averages in linear light instead. Both need a
+    32bpp format.
+
+    leanloader_convert does the usual after-load chores in place on a 32bpp image: RGBA
+    swizzle, premultiply, unpremultiply, sRGB to linear and a vertical flip. The kernels are
+    picked at run time for SSE2, AVX2 or AVX-512, and use the padding at the end of the
+    buffer to skip tail loops altogether.
+
+    Textures headed for the GPU can come out block compressed instead: set the format field
+    to LEANLOADER_FORMAT_BC1 (opaque or 1-bit alpha), _BC3 or _BC7, or call
+    leanloader_compress on an image that's already loaded. The image is decoded as ARGB as
+    usual and then encoded block by block, mips included, into a buffer a quarter to an
+    eighth the size; bd.stride is then the pitch of a row of 4x4 blocks. The encoder is
+    built for load time rather than for the best possible quality (BC7 only uses mode 6).
+    Both caches keep the compressed blocks. The region, row, scaled and atlas loaders only
+    produce pixels, and fail with LEANLOADER_ERROR_UNSUPPORTED for these formats.
+
+    Sizes are computed in 64 bits throughout, so images well past 4GB of pixels load fine
+    (GDI+ itself may give up sooner.) With LEANLOADER_LARGE_PAGES set, pixel buffers of a
+    large page or more are allocated with MEM_LARGE_PAGES, which spares SIMD passes over
+    them a lot of TLB misses; this needs the "lock pages in memory" privilege enabled in
+    the process token, and quietly falls back to regular pages without it.
+
+    Set LEANLOADER_CACHED to go through a process-wide cache of decoded images, once
+    leanloader_cache_budget has turned it on. Files are told apart by full path, size and
+    last write time, so a changed file is loaded afresh. Repeat loads of the same file (with
+    the same format and mip flags) share one refcounted, read-only pixel buffer: don't write
+    to it. Entries nobody uses anymore go least recently used first once the budget is
+    exceeded. Loads into dst bypass the cache.
+
+    LEANLOADER_DISK_CACHED keeps the decoded pixels in a directory set with
+    leanloader_cache_dir. The first load of a file writes them out as a blob; later ones
+    (in this process or the next) map the blob copy-on-write and point bd.ptr into it, with
+    nothing decoded or copied. The blob keeps our usual 64-byte alignment and padding, and
+    dispose just unmaps it.
+
+    Loads that run at the same few sizes over and over can skip the allocator: once
+    leanloader_pool_budget has turned the buffer pool on, disposed pixel buffers are kept
+    (up to the budget) and handed to the next load that needs one exactly that big.
+
+    When a load fails, the error field says why (LEANLOADER_ERROR_*). Files are sniffed
+    before anything else happens to them: a truncated or malformed BMP or PNG header, or a
+    file that isn't any format GDI+ reads, fails right there without GDI+ ever being
+    started. Set maxpixels to refuse images bigger than that, again before decoding. The
+    same goes for rects, tiles, rows, scaled loads and frames.
+
+    A catalog of thousands of images needn't hold thousands of decoded ones. With
+    LEANLOADER_DEFERRED set, leanloader_load only reads the header: bd.w and bd.h are
+    filled in, and bd.ptr stays null. leanloader_pixels decodes the pixels the first time
+    it's called, then just hands them out. leanloader_deferred_budget caps how much such
+    images hold between them; past that, the ones used longest ago are evicted back to the
+    header, and the next leanloader_pixels decodes them again. leanloader_evict does the
+    same for one image by hand. Since another image's leanloader_pixels (on any thread) can
+    evict this one, ask for the pointer again before each use while a budget is set, or
+    hold it with leanloader_pin instead: a pinned image stays in until leanloader_unpin,
+    whatever the budget says. Any number of threads may ask for the same image at once;
+    one of them decodes it and the others wait for that.
+
     Call leanloader_dispose when done with the image to free associated resources.
+
+    Build with LEANLOADER_STATS defined to 1 to have loads, disposes and GDI+ startups
+    counted and timed (with rdtsc, so it's cheap): bytes read, pixels produced, bytes
+    allocated, GDI+ errors, cache hits and the time spent in each. leanloader_get_stats
+    takes a snapshot at any time. Without it, none of this is compiled in.
+
+    GDI+ is started on demand and shut down again when the last image using it is disposed
+    of. If you load images one after another, call leanloader_init once up front (and
+    leanloader_shutdown at the end) to keep it running in between instead of paying for
+    LoadLibrary and GdiplusStartup on every image. Calls nest, so libraries sharing
+    leanloader can each do their own.
+
+    To load many images at once, fill in an array of structs and call leanloader_load_batch;
+    it spreads the files over a pool of threads, biggest first, and reports each file's
+    result in a status array. Every image is then disposed of individually as usual.
+
+    Lots of small images (icons, UI sets) can go into one atlas with leanloader_load_atlas
+    instead: it reads their sizes from the headers, packs them onto a skyline no wider than
+    asked, and decodes each one straight into its spot in a single buffer, which the info
+    struct then describes like any other image. The rect table says where each one went,
+    in pixels and in texture coordinates.
+
+    leanloader_load_async queues a load on the Windows thread pool and returns right away
+    with a handle. The optional callback runs on the pool thread once the load is done;
+    leanloader_async_wait (with a 0 timeout to just poll) or the event handle from
+    leanloader_async_event tell you when it is. leanloader_async_close frees the handle
+    (waiting for the load to finish if it has to), but not the image.
 */
 
+// flags for the leanloader_image_info struct
+#define LEANLOADER_DETACHED     0x0001  // don't keep the GDI+ bitmap around after the load
+#define LEANLOADER_MAPPED       0x0002  // let bd.ptr point into a private view of the file when possible
+#define LEANLOADER_NO_NATIVE    0x0004  // always go through GDI+, even for formats we can parse ourselves
+#define LEANLOADER_LARGE_PAGES  0x0008  // put big pixel buffers in large pages, if the process may
+#define LEANLOADER_MIPMAPS      0x0010  // build the mip chain behind the image, see the mip field
+#define LEANLOADER_MIPMAPS_SRGB 0x0020  // same, averaging the colors in linear light
+#define LEANLOADER_CACHED       0x0040  // share the pixels through the decoded image cache, see leanloader_cache_budget
+#define LEANLOADER_DISK_CACHED  0x0080  // map the pixels from the disk cache, see leanloader_cache_dir
+#define LEANLOADER_PARALLEL     0x0100  // inflate big PNGs on other threads, see leanloader_png_parallel
+#define LEANLOADER_DEFERRED     0x0200  // only read the header, the pixels come with leanloader_pixels
+
+// output formats for the format field (0 means LEANLOADER_FORMAT_ARGB). all but GRAY8 are
+// the GDI+ PixelFormat values of the same name and go straight through to GdipBitmapLockBits.
+#define LEANLOADER_FORMAT_ARGB      0x0026200a  // 32bpp, B G R A in memory
+#define LEANLOADER_FORMAT_PARGB     0x000e200b  // 32bpp, premultiplied alpha
+#define LEANLOADER_FORMAT_RGB24     0x00021808  // 24bpp, B G R
+#define LEANLOADER_FORMAT_ARGB64    0x0034400d  // 64bpp, GDI+'s linear 0..8192 flavor, so always decoded by GDI+
+#define LEANLOADER_FORMAT_GRAY8     0x00000810  // 8bpp luma, alpha is dropped; not a GDI+ format
+// block compressed formats, see leanloader_compress; not GDI+ formats either. bd.stride is
+// the distance from one row of 4x4 blocks to the next.
+#define LEANLOADER_FORMAT_BC1       0x00000411  // 8 bytes per block, 1-bit alpha
+#define LEANLOADER_FORMAT_BC3       0x00000812  // 16 bytes per block, BC1 color plus 3-bit alpha indices
+#define LEANLOADER_FORMAT_BC7       0x00000813  // 16 bytes per block
+
+// steps for leanloader_convert, done in this order
+#define LEANLOADER_CONVERT_UNPREMULTIPLY    0x0001  // back to straight alpha
+#define LEANLOADER_CONVERT_LINEAR           0x0002  // sRGB to linear, 8 bits per channel, via a table
+#define LEANLOADER_CONVERT_PREMULTIPLY      0x0004  // multiply the colors by alpha
+#define LEANLOADER_CONVERT_RGBA             0x0008  // swap red and blue, for R G B A in memory
+#define LEANLOADER_CONVERT_FLIP             0x0010  // bottom row first, the way GL wants it
+
+// why a load failed, in the error field
+#define LEANLOADER_ERROR_NONE           0
+#define LEANLOADER_ERROR_OPEN           1   // the file couldn't be opened or mapped
+#define LEANLOADER_ERROR_FORMAT         2   // not a format we or GDI+ can read
+#define LEANLOADER_ERROR_CORRUPT        3   // a known format, but the header or the data is broken
+#define LEANLOADER_ERROR_TOO_BIG        4   // more than maxpixels pixels, or rows wider than 2GB
+#define LEANLOADER_ERROR_MEMORY         5   // the pixel buffer couldn't be allocated
+#define LEANLOADER_ERROR_DST            6   // the image doesn't fit dst, or dststride is too small
+#define LEANLOADER_ERROR_UNSUPPORTED    7   // the format or flags asked for can't be had (mips need 32bpp)
+#define LEANLOADER_ERROR_GDIPLUS        8   // GDI+ couldn't be started, or failed some other way
+
+// where the pixel buffer came from, so leanloader_dispose knows how to give it back
+#define LEANLOADER_STORAGE_GLOBAL   0   // GlobalAlloc
+#define LEANLOADER_STORAGE_VIEW     1   // a copy-on-write view of the file, info->view is its base
+#define LEANLOADER_STORAGE_CALLER   2   // info->dst, not ours to free
+#define LEANLOADER_STORAGE_HOOK     3   // the allocator hooks
+#define LEANLOADER_STORAGE_VIRTUAL  4   // VirtualAlloc, backed by large pages
+#define LEANLOADER_STORAGE_CACHE    5   // a cache entry's, info->cache holds our reference on it
+#define LEANLOADER_STORAGE_POOL     6   // GlobalAlloc, goes back to the buffer pool when disposed of
+
 // a few structs used internally
 
 typedef struct {
     u32 w;              // image width
     u32 h;              // image height
-    i32 stride;         // image stride (in bytes, always width * 4)
-    u32 PixelFormat;    // pixel format, always 0x0026200a for 32-bit ARGB
+    i32 stride;         // image stride (in bytes, width * 4 for ARGB unless dststride says otherwise)
+    u32 PixelFormat;    // pixel format, one of LEANLOADER_FORMAT_*
     ptr ptr;            // pointer to the first pixel of the image
     ptr Reserved;       // reserved
 } BitmapData;
 
+// one level of a mip chain
+typedef struct {
+    u64 offset;         // from bd.ptr, a multiple of 64
+    u64 size;           // in bytes
+    u32 w;
+    u32 h;
+    i32 stride;
+} leanloader_mip;
+
+#define LEANLOADER_MAX_MIPS 32
+
 typedef struct {
     wchar* name;        // name of the image file to load
     BitmapData bd;      // bitmap data, filled in by leanloader_load
     ptr gpbitmap;       // GDI+ bitmap handle, used internally
+    u32 flags;          // LEANLOADER_* flags, set by the caller
+    u32 storage;        // LEANLOADER_STORAGE_* for bd.ptr, used internally
+    ptr view;           // base of the mapped view when storage is LEANLOADER_STORAGE_VIEW, used internally
+    ptr cache;          // the cache entry when storage is LEANLOADER_STORAGE_CACHE, used internally
+    u64 allocsize;      // size of the buffer when storage is LEANLOADER_STORAGE_POOL, used internally
+    u32 envref;         // nonzero if we hold a reference on the GDI+ environment, used internally
+    ptr dst;            // optional destination for the pixels, set by the caller
+    i32 dststride;      // stride of dst in bytes (0 for width * 4), set by the caller
+    u64 dstsize;        // size of dst in bytes, set by the caller
+    u32 format;         // LEANLOADER_FORMAT_* to convert to (0 for ARGB), set by the caller
+    u32 mips;           // number of levels in mip (the image itself included), 0 without LEANLOADER_MIPMAPS
+    leanloader_mip mip[LEANLOADER_MAX_MIPS];
+    u32 frames;         // frames stacked in bd by leanloader_load_frames, 0 otherwise
+    u64 maxpixels;      // refuse images with more pixels than this (0 for no limit), set by the caller
+    u32 error;          // LEANLOADER_ERROR_* if the load failed, filled in by leanloader_load
+    ptr newer;          // resident LEANLOADER_DEFERRED images, in order of last use, used internally
+    ptr older;
+    u64 resident;       // what the pixels count against the deferred budget while they're in, used internally
+    u32 pins;           // leanloader_pin calls not yet undone by leanloader_unpin, used internally
+    u32 loading;        // a leanloader_pixels is decoding the pixels right now, used internally
 } leanloader_image_info;
 
+// what leanloader_get_stats reports. times are in TSC ticks.
+typedef struct {
+    u64 loads;          // leanloader_load calls
+    u64 failures;       // of those, the ones that failed
+    u64 native;         // images decoded without GDI+
+    u64 cachehits;      // loads served by the decoded image cache
+    u64 diskhits;       // loads served by the disk cache
+    u64 poolhits;       // pixel buffers reused from the buffer pool
+    u64 pixels;         // pixels delivered by successful loads
+    u64 bytesread;      // file bytes mapped or read
+    u64 allocs;         // pixel buffers allocated (not counting the reused ones)
+    u64 allocbytes;     // their total size
+    u64 gdipstartups;   // times GDI+ was actually started (not just referenced)
+    u64 gdipfailures;   // GDI+ calls that returned an error status
+    u64 disposes;
+    u64 loadticks;      // in leanloader_load, everything below included
+    u64 ioticks;        // opening and mapping files
+    u64 allocticks;     // allocating (and zeroing the tails of) pixel buffers
+    u64 gdipticks;      // starting GDI+
+    u64 disposeticks;
+} leanloader_stats;
+
+// optional allocator hooks for the pixel buffers, see leanloader_set_allocator
+typedef ptr (*leanloader_alloc_t)(u64 size, ptr userdata);
+typedef void (*leanloader_free_t)(ptr p, ptr userdata);
+
 typedef struct {
     u32 GdiplusVersion;             // Must be 1
     ptr DebugEventCallback;         // blah
@@ -60,23 +325,67 @@ typedef struct {
 #define _BASIC_KERNEL_DEFINED
 typedef ptr (*LoadLibraryA_t)(char *name);
 typedef void (*FreeLibrary_t)(ptr modulehandle);
-typedef ptr (*GlobalAlloc_t)(u32 flags, u32 size);
+typedef ptr (*GlobalAlloc_t)(u32 flags, u64 size);
 typedef u32 (*GlobalFree_t)(ptr ptr);
+typedef ptr (*VirtualAlloc_t)(ptr address, u64 size, u32 type, u32 protect);
+typedef u32 (*VirtualFree_t)(ptr address, u64 size, u32 type);
+typedef u64 (*GetLargePageMinimum_t)();
 #endif
+typedef ptr (*CreateFileW_t)(wchar* name, u32 access, u32 share, ptr security, u32 disposition, u32 flags, ptr templ);
+typedef u32 (*GetFileSizeEx_t)(ptr file, i64* size);
+typedef u32 (*ReadFile_t)(ptr file, ptr buffer, u32 size, u32* read, ptr overlapped);
+typedef u32 (*WriteFile_t)(ptr file, ptr buffer, u32 size, u32* written, ptr overlapped);
+typedef u32 (*MoveFileExW_t)(wchar* from, wchar* to, u32 flags);
+typedef u32 (*DeleteFileW_t)(wchar* name);
+typedef ptr (*CreateFileMappingW_t)(ptr file, ptr security, u32 protect, u32 sizehigh, u32 sizelow, wchar* name);
+typedef ptr (*MapViewOfFile_t)(ptr mapping, u32 access, u32 offsethigh, u32 offsetlow, u64 size);
+typedef u32 (*UnmapViewOfFile_t)(ptr base);
+typedef u32 (*CloseHandle_t)(ptr handle);
+typedef void (*AcquireSRWLockExclusive_t)(ptr* lock);
+typedef void (*ReleaseSRWLockExclusive_t)(ptr* lock);
+typedef u32 (*SleepConditionVariableSRW_t)(ptr* cond, ptr* lock, u32 milliseconds, u32 flags);
+typedef void (*WakeAllConditionVariable_t)(ptr* cond);
+typedef u32 (*ThreadProc_t)(ptr param);
+typedef ptr (*CreateThread_t)(ptr security, u64 stacksize, ThreadProc_t proc, ptr param, u32 flags, u32* threadid);
+typedef u32 (*WaitForSingleObject_t)(ptr handle, u32 milliseconds);
+typedef u32 (*GetActiveProcessorCount_t)(u16 group);
+typedef u32 (*GetFileAttributesExW_t)(wchar* name, u32 level, ptr data);
+typedef u32 (*GetFullPathNameW_t)(wchar* name, u32 size, wchar* buffer, wchar** filepart);
+typedef void (*SimpleCallback_t)(ptr instance, ptr context);
+typedef u32 (*TrySubmitThreadpoolCallback_t)(SimpleCallback_t callback, ptr context, ptr environment);
+typedef void (*SetEventWhenCallbackReturns_t)(ptr instance, ptr event);
+typedef ptr (*CreateEventW_t)(ptr security, u32 manualreset, u32 initialstate, wchar* name);
 // gdiplus:
 typedef u32 (*GdipStartup_t)(ptr* token, GdiplusStartupInput* input, ptr output);
 typedef u32 (*GdipShutdown_t)(ptr token);
 typedef u32 (*GdipCreateBitmapFromFile_t)(wchar* filename, ptr* bitmap);
+typedef u32 (*GdipCreateBitmapFromStream_t)(ptr stream, ptr* bitmap);
+typedef u32 (*GdipLoadImageFromFile_t)(wchar* filename, ptr* image);
+typedef u32 (*GdipGetImagePixelFormat_t)(ptr image, u32* format);
 typedef u32 (*GdipDisposeImage_t)(ptr image);
 typedef u32 (*GdipGetImageWidth_t)(ptr image, u32* width);
 typedef u32 (*GdipGetImageHeight_t)(ptr image, u32* height);
 typedef u32 (*GdipBitmapLockBits_t)(ptr bitmap, ptr rect, u32 flags, u32 format, ptr lockedbitmapdata);
 typedef u32 (*GdipBitmapUnlockBits_t)(ptr bitmap, ptr lockedbitmapdata);
+typedef u32 (*GdipImageGetFrameDimensionsCount_t)(ptr image, u32* count);
+typedef u32 (*GdipImageGetFrameDimensionsList_t)(ptr image, ptr dimensionids, u32 count);
+typedef u32 (*GdipImageGetFrameCount_t)(ptr image, ptr dimensionid, u32* count);
+typedef u32 (*GdipImageSelectActiveFrame_t)(ptr image, ptr dimensionid, u32 index);
+typedef u32 (*GdipGetPropertyItemSize_t)(ptr image, u32 propid, u32* size);
+typedef u32 (*GdipGetPropertyItem_t)(ptr image, u32 propid, u32 size, ptr buffer);
+
+// instruction set levels for the pixel kernels, detected at run time
+#define LEANLOADER_CPU_SCALAR   0
+#define LEANLOADER_CPU_SSE2     1
+#define LEANLOADER_CPU_AVX2     2
+#define LEANLOADER_CPU_AVX512   3   // F and BW
 
 // a single-instance global global struct that holds module handles and function pointers
 typedef struct {
     ptr token;
-    u32 refcnt;
+    u32 refcnt;         // GDI+ references, only ever changed with interlocked ops
+    u32 kernelinit;     // 0: kernel32 not resolved yet, 1: being resolved, 2: done
+    ptr lock;           // SRWLOCK serializing GDI+ startup and shutdown
     ptr kernel32;
     ptr gdiplus;
     GetProcAddress_t            GetProcAddress;
@@ -84,124 +393,5419 @@ typedef struct {
     FreeLibrary_t               FreeLibrary;
     GlobalAlloc_t               GlobalAlloc;
     GlobalFree_t                GlobalFree;
+    VirtualAlloc_t              VirtualAlloc;
+    VirtualFree_t               VirtualFree;
+    GetLargePageMinimum_t       GetLargePageMinimum;
+    u64                         largepage;  // large page size, 0 if there are none
+    u32                         cpu;        // LEANLOADER_CPU_* the kernels may use
+    CreateFileW_t               CreateFileW;
+    GetFileSizeEx_t             GetFileSizeEx;
+    ReadFile_t                  ReadFile;
+    WriteFile_t                 WriteFile;
+    MoveFileExW_t               MoveFileExW;
+    DeleteFileW_t               DeleteFileW;
+    CreateFileMappingW_t        CreateFileMappingW;
+    MapViewOfFile_t             MapViewOfFile;
+    UnmapViewOfFile_t           UnmapViewOfFile;
+    CloseHandle_t               CloseHandle;
+    AcquireSRWLockExclusive_t   AcquireSRWLockExclusive;
+    ReleaseSRWLockExclusive_t   ReleaseSRWLockExclusive;
+    SleepConditionVariableSRW_t SleepConditionVariableSRW;
+    WakeAllConditionVariable_t  WakeAllConditionVariable;
+    CreateThread_t              CreateThread;
+    WaitForSingleObject_t       WaitForSingleObject;
+    GetActiveProcessorCount_t   GetActiveProcessorCount;
+    GetFileAttributesExW_t      GetFileAttributesExW;
+    GetFullPathNameW_t          GetFullPathNameW;
+    TrySubmitThreadpoolCallback_t TrySubmitThreadpoolCallback;
+    SetEventWhenCallbackReturns_t SetEventWhenCallbackReturns;
+    CreateEventW_t              CreateEventW;
+    leanloader_alloc_t          alloc;      // allocator hooks for pixel buffers, if set
+    leanloader_free_t           free;
+    ptr                         allocdata;
+    wchar*                      cachedir;   // where LEANLOADER_DISK_CACHED keeps its blobs, if set
     GdipStartup_t               GdipStartup;
     GdipShutdown_t              GdipShutdown;
     GdipCreateBitmapFromFile_t  GdipCreateBitmapFromFile;
+    GdipCreateBitmapFromStream_t GdipCreateBitmapFromStream;
+    GdipLoadImageFromFile_t     GdipLoadImageFromFile;
+    GdipGetImagePixelFormat_t   GdipGetImagePixelFormat;
     GdipDisposeImage_t          GdipDisposeImage;
     GdipGetImageWidth_t         GdipGetImageWidth;
     GdipGetImageHeight_t        GdipGetImageHeight;
     GdipBitmapLockBits_t        GdipBitmapLockBits;
     GdipBitmapUnlockBits_t      GdipBitmapUnlockBits;
+    GdipImageGetFrameDimensionsCount_t GdipImageGetFrameDimensionsCount;
+    GdipImageGetFrameDimensionsList_t GdipImageGetFrameDimensionsList;
+    GdipImageGetFrameCount_t    GdipImageGetFrameCount;
+    GdipImageSelectActiveFrame_t GdipImageSelectActiveFrame;
+    GdipGetPropertyItemSize_t   GdipGetPropertyItemSize;
+    GdipGetPropertyItem_t       GdipGetPropertyItem;
 } env_t;
 
 static env_t env = {0};
 
-// an internal function to initialize the "runtime environment"
+// the counters are only ever bumped with relaxed interlocked adds. without LEANLOADER_STATS,
+// the macros still evaluate nothing but constants, so they're gone from the build entirely.
+#if LEANLOADER_STATS
+static leanloader_stats leanloader_counters = {0};
+#define LEANLOADER_COUNT(field, n)  __atomic_add_fetch(&leanloader_counters.field, (u64)(n), __ATOMIC_RELAXED)
+#define LEANLOADER_TICKS()          __builtin_ia32_rdtsc()
+#else
+#define LEANLOADER_COUNT(field, n)  ((void)(n))
+#define LEANLOADER_TICKS()          0
+#endif
+
+// bulk copy and fill, so we don't need memcpy and memset from the CRT. rep movsb/stosb are
+// about as fast as it gets on anything recent, and gcc won't turn them back into calls.
+static void leanloader_copy(ptr dst, ptr src, u64 n) {
+    __asm__ volatile ("rep movsb" : "+D"(dst), "+S"(src), "+c"(n) : : "memory");
+}
+
+static void leanloader_fill(ptr dst, u8 value, u64 n) {
+    __asm__ volatile ("rep stosb" : "+D"(dst), "+c"(n) : "a"(value) : "memory");
+}
+
+// for unaligned loads and stores that gcc won't trip over with strict aliasing
+typedef u64 __attribute__((may_alias, aligned(1))) leanloader_u64u;
+typedef u32 __attribute__((may_alias, aligned(1))) leanloader_u32u;
+typedef i32 __attribute__((may_alias, aligned(1))) leanloader_i32u;
+
+// a minimal read-only IStream over a block of memory, so GDI+ can decode straight from
+// the caller's bytes. SHCreateMemStream would do, but it makes a copy of the data.
+typedef struct {
+    u32 d1;
+    u16 d2;
+    u16 d3;
+    u8  d4[8];
+} GUID;
+
+typedef struct {
+    wchar* pwcsName;            // always null, we don't have a name
+    u32 type;                   // STGTY_STREAM
+    u64 cbSize;                 // size of the stream in bytes
+    u64 mtime;                  // FILETIMEs, left at zero
+    u64 ctime;
+    u64 atime;
+    u32 grfMode;
+    u32 grfLocksSupported;
+    GUID clsid;
+    u32 grfStateBits;
+    u32 reserved;
+} STATSTG;
+
+typedef struct {
+    ptr* vtbl;                  // must be first, this is what makes it a COM object
+    u32 refcnt;
+    u8* data;
+    u64 size;
+    u64 pos;
+} leanloader_stream;
+
+static ptr leanloader_stream_create(u8* data, u64 size, u64 pos);
+
+static u32 leanloader_stream_addref(leanloader_stream* s) {
+    return __atomic_add_fetch(&s->refcnt, 1, __ATOMIC_RELAXED);
+}
+
+static u32 leanloader_stream_release(leanloader_stream* s) {
+    u32 refcnt = __atomic_sub_fetch(&s->refcnt, 1, __ATOMIC_ACQ_REL);
+    if (refcnt == 0)
+        env.GlobalFree(s);
+    return refcnt;
+}
+
+static u32 leanloader_stream_queryinterface(leanloader_stream* s, GUID* riid, ptr* out) {
+    // IUnknown, ISequentialStream and IStream are all we answer to
+    static GUID iids[3] = {
+        {0x00000000, 0x0000, 0x0000, {0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46}},
+        {0x0c733a30, 0x2a1c, 0x11ce, {0xad, 0xe5, 0x00, 0xaa, 0x00, 0x44, 0x77, 0x3d}},
+        {0x0000000c, 0x0000, 0x0000, {0xc0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46}},
+    };
+    for (u32 i = 0; i < 3; i++) {
+        u64* a = (u64*)&iids[i];
+        u64* b = (u64*)riid;
+        if (a[0] == b[0] && a[1] == b[1]) {
+            leanloader_stream_addref(s);
+            *out = s;
+            return 0;
+        }
+    }
+    *out = 0;
+    return 0x80004002;          // E_NOINTERFACE
+}
+
+static u32 leanloader_stream_read(leanloader_stream* s, u8* pv, u32 cb, u32* pcbRead) {
+    u64 avail = s->pos < s->size ? s->size - s->pos : 0;
+    u64 n = cb < avail ? cb : avail;
+    leanloader_copy(pv, s->data + s->pos, n);
+    s->pos += n;
+    if (pcbRead)
+        *pcbRead = (u32)n;
+    return n == cb ? 0 : 1;     // S_OK or S_FALSE
+}
+
+static u32 leanloader_stream_write(leanloader_stream* s, ptr pv, u32 cb, u32* pcbWritten) {
+    if (pcbWritten)
+        *pcbWritten = 0;
+    return 0x80030005;          // STG_E_ACCESSDENIED
+}
+
+static u32 leanloader_stream_seek(leanloader_stream* s, i64 move, u32 origin, u64* newpos) {
+    i64 base;
+    switch (origin) {
+        case 0:  base = 0;              break;  // STREAM_SEEK_SET
+        case 1:  base = (i64)s->pos;    break;  // STREAM_SEEK_CUR
+        case 2:  base = (i64)s->size;   break;  // STREAM_SEEK_END
+        default: return 0x80030001;             // STG_E_INVALIDFUNCTION
+    }
+    if (base + move < 0)
+        return 0x80030019;                      // STG_E_INVALIDPOINTER
+    s->pos = (u64)(base + move);
+    if (newpos)
+        *newpos = s->pos;
+    return 0;
+}
+
+static u32 leanloader_stream_notimpl() {
+    return 0x80004001;          // E_NOTIMPL
+}
+
+static u32 leanloader_stream_commit(leanloader_stream* s, u32 flags) {
+    return 0;
+}
+
+static u32 leanloader_stream_stat(leanloader_stream* s, STATSTG* stat, u32 flags) {
+    leanloader_fill(stat, 0, sizeof(STATSTG));
+    stat->type = 2;             // STGTY_STREAM
+    stat->cbSize = s->size;
+    return 0;
+}
+
+static u32 leanloader_stream_clone(leanloader_stream* s, ptr* out) {
+    *out = leanloader_stream_create(s->data, s->size, s->pos);
+    return *out ? 0 : 0x8007000e;               // E_OUTOFMEMORY
+}
+
+static ptr leanloader_stream_vtbl[14] = {
+    leanloader_stream_queryinterface,
+    leanloader_stream_addref,
+    leanloader_stream_release,
+    leanloader_stream_read,
+    leanloader_stream_write,
+    leanloader_stream_seek,
+    leanloader_stream_notimpl,  // SetSize
+    leanloader_stream_notimpl,  // CopyTo
+    leanloader_stream_commit,
+    leanloader_stream_notimpl,  // Revert
+    leanloader_stream_notimpl,  // LockRegion
+    leanloader_stream_notimpl,  // UnlockRegion
+    leanloader_stream_stat,
+    leanloader_stream_clone,
+};
+
+// creates a stream with a reference count of one; the data is not copied
+static ptr leanloader_stream_create(u8* data, u64 size, u64 pos) {
+    u32 GPTR = 0x0040;
+    leanloader_stream* s = env.GlobalAlloc(GPTR, sizeof(leanloader_stream));
+    if (s) {
+        s->vtbl   = leanloader_stream_vtbl;
+        s->refcnt = 1;
+        s->data   = data;
+        s->size   = size;
+        s->pos    = pos;
+    }
+    return s;
+}
+
+// the best instruction set level that both the CPU and the OS support
+static u32 leanloader_cpu_detect() {
+#if defined(__SSE2__)
+    u32 a, b, c, d;
+    u32 level = LEANLOADER_CPU_SSE2;
+    // AVX needs the OS to save the ymm (and for AVX-512, the zmm) registers: OSXSAVE and AVX,
+    // then XCR0 has to say so
+    if (__get_cpuid(1, &a, &b, &c, &d) && (c & 0x18000000) == 0x18000000) {
+        u32 xcr0, xcr0hi;
+        __asm__ ("xgetbv" : "=a"(xcr0), "=d"(xcr0hi) : "c"(0));
+        if (__get_cpuid_count(7, 0, &a, &b, &c, &d)) {
+            if ((xcr0 & 0x06) == 0x06 && (b & 1 << 5))
+                level = LEANLOADER_CPU_AVX2;
+            if ((xcr0 & 0xe6) == 0xe6 && (b & 1 << 5) && (b & 1 << 16) && (b & 1 << 30))
+                level = LEANLOADER_CPU_AVX512;
+        }
+    }
+    return level;
+#else
+    return LEANLOADER_CPU_SCALAR;
+#endif
+}
+
+// sRGB to linear in 16 bits, round(65535 * linear(i / 255)), for gamma-correct mipmaps
+static u16 leanloader_srgb_linear16[256] = {
+        0,    20,    40,    60,    80,    99,   119,   139,   159,   179,   199,   219,   241,   264,   288,   313,
+      340,   367,   396,   427,   458,   491,   526,   562,   599,   637,   677,   718,   761,   805,   851,   898,
+      947,   997,  1048,  1101,  1156,  1212,  1270,  1330,  1391,  1453,  1517,  1583,  1651,  1720,  1790,  1863,
+     1937,  2013,  2090,  2170,  2250,  2333,  2418,  2504,  2592,  2681,  2773,  2866,  2961,  3058,  3157,  3258,
+     3360,  3464,  3570,  3678,  3788,  3900,  4014,  4129,  4247,  4366,  4488,  4611,  4736,  4864,  4993,  5124,
+     5257,  5392,  5530,  5669,  5810,  5953,  6099,  6246,  6395,  6547,  6700,  6856,  7014,  7174,  7335,  7500,
+     7666,  7834,  8004,  8177,  8352,  8528,  8708,  8889,  9072,  9258,  9445,  9635,  9828, 10022, 10219, 10417,
+    10619, 10822, 11028, 11235, 11446, 11658, 11873, 12090, 12309, 12530, 12754, 12980, 13209, 13440, 13673, 13909,
+    14146, 14387, 14629, 14874, 15122, 15371, 15623, 15878, 16135, 16394, 16656, 16920, 17187, 17456, 17727, 18001,
+    18277, 18556, 18837, 19121, 19407, 19696, 19987, 20281, 20577, 20876, 21177, 21481, 21787, 22096, 22407, 22721,
+    23038, 23357, 23678, 24002, 24329, 24658, 24990, 25325, 25662, 26001, 26344, 26688, 27036, 27386, 27739, 28094,
+    28452, 28813, 29176, 29542, 29911, 30282, 30656, 31033, 31412, 31794, 32179, 32567, 32957, 33350, 33745, 34143,
+    34544, 34948, 35355, 35764, 36176, 36591, 37008, 37429, 37852, 38278, 38706, 39138, 39572, 40009, 40449, 40891,
+    41337, 41785, 42236, 42690, 43147, 43606, 44069, 44534, 45002, 45473, 45947, 46423, 46903, 47385, 47871, 48359,
+    48850, 49344, 49841, 50341, 50844, 51349, 51858, 52369, 52884, 53401, 53921, 54445, 54971, 55500, 56032, 56567,
+    57105, 57646, 58190, 58737, 59287, 59840, 60396, 60955, 61517, 62082, 62650, 63221, 63795, 64372, 64952, 65535,
+};
+
+// and back, from the top 12 bits of a linear value; filled in by leanloader_kernel_init
+static u8 leanloader_linear16_srgb[4096];
+
+// each entry gets the sRGB value whose linear value is nearest to the middle of its bucket
+static void leanloader_srgb_init() {
+    u32 s = 0;
+    for (u32 i = 0; i < 4096; i++) {
+        u32 v = i * 16 + 8;
+        while (s < 255 && (u32)leanloader_srgb_linear16[s] + leanloader_srgb_linear16[s + 1] < 2 * v)
+            s++;
+        leanloader_linear16_srgb[i] = (u8)s;
+    }
+}
+
+// an internal function to resolve what we need from kernel32. kernel32 never goes away,
+// so this is done once and never undone; it's all the native decoders need. the first
+// caller does the work, anyone else arriving meanwhile spins until it's done.
+static void leanloader_kernel_init() {
+    if (__atomic_load_n(&env.kernelinit, __ATOMIC_ACQUIRE) == 2)
+        return;
+    u32 expected = 0;
+    if (__atomic_compare_exchange_n(&env.kernelinit, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+        env.kernel32           = gpa_getkernel32();
+        env.GetProcAddress     = gpa_getgetprocaddress(env.kernel32);
+        env.LoadLibraryA       = env.GetProcAddress(env.kernel32, "LoadLibraryA");
+        env.FreeLibrary        = env.GetProcAddress(env.kernel32, "FreeLibrary");
+        env.GlobalAlloc        = env.GetProcAddress(env.kernel32, "GlobalAlloc");
+        env.GlobalFree         = env.GetProcAddress(env.kernel32, "GlobalFree");
+        env.VirtualAlloc       = env.GetProcAddress(env.kernel32, "VirtualAlloc");
+        env.VirtualFree        = env.GetProcAddress(env.kernel32, "VirtualFree");
+        env.GetLargePageMinimum = env.GetProcAddress(env.kernel32, "GetLargePageMinimum");
+        env.largepage          = env.GetLargePageMinimum();
+        env.cpu                = leanloader_cpu_detect();
+        leanloader_srgb_init();
+        env.CreateFileW        = env.GetProcAddress(env.kernel32, "CreateFileW");
+        env.GetFileSizeEx      = env.GetProcAddress(env.kernel32, "GetFileSizeEx");
+        env.ReadFile           = env.GetProcAddress(env.kernel32, "ReadFile");
+        env.WriteFile          = env.GetProcAddress(env.kernel32, "WriteFile");
+        env.MoveFileExW        = env.GetProcAddress(env.kernel32, "MoveFileExW");
+        env.DeleteFileW        = env.GetProcAddress(env.kernel32, "DeleteFileW");
+        env.CreateFileMappingW = env.GetProcAddress(env.kernel32, "CreateFileMappingW");
+        env.MapViewOfFile      = env.GetProcAddress(env.kernel32, "MapViewOfFile");
+        env.UnmapViewOfFile    = env.GetProcAddress(env.kernel32, "UnmapViewOfFile");
+        env.CloseHandle        = env.GetProcAddress(env.kernel32, "CloseHandle");
+        env.AcquireSRWLockExclusive = env.GetProcAddress(env.kernel32, "AcquireSRWLockExclusive");
+        env.ReleaseSRWLockExclusive = env.GetProcAddress(env.kernel32, "ReleaseSRWLockExclusive");
+        env.SleepConditionVariableSRW = env.GetProcAddress(env.kernel32, "SleepConditionVariableSRW");
+        env.WakeAllConditionVariable = env.GetProcAddress(env.kernel32, "WakeAllConditionVariable");
+        env.CreateThread       = env.GetProcAddress(env.kernel32, "CreateThread");
+        env.WaitForSingleObject = env.GetProcAddress(env.kernel32, "WaitForSingleObject");
+        env.GetActiveProcessorCount = env.GetProcAddress(env.kernel32, "GetActiveProcessorCount");
+        env.GetFileAttributesExW = env.GetProcAddress(env.kernel32, "GetFileAttributesExW");
+        env.GetFullPathNameW   = env.GetProcAddress(env.kernel32, "GetFullPathNameW");
+        env.TrySubmitThreadpoolCallback = env.GetProcAddress(env.kernel32, "TrySubmitThreadpoolCallback");
+        env.SetEventWhenCallbackReturns = env.GetProcAddress(env.kernel32, "SetEventWhenCallbackReturns");
+        env.CreateEventW       = env.GetProcAddress(env.kernel32, "CreateEventW");
+        __atomic_store_n(&env.kernelinit, 2, __ATOMIC_RELEASE);
+    } else {
+        while (__atomic_load_n(&env.kernelinit, __ATOMIC_ACQUIRE) != 2)
+            __builtin_ia32_pause();
+    }
+}
+
+// an internal function to initialize the "runtime environment". taking another reference
+// while GDI+ is already up is a single interlocked op; starting it up (and shutting it down,
+// below) happens under env.lock, so the two never overlap.
 static i32 leanloader_env_init() {
-    if (env.refcnt == 0) {
-        env.kernel32       = gpa_getkernel32();
-        env.GetProcAddress = gpa_getgetprocaddress(env.kernel32);
-        env.LoadLibraryA   = env.GetProcAddress(env.kernel32, "LoadLibraryA");
-        env.FreeLibrary    = env.GetProcAddress(env.kernel32, "FreeLibrary");
-        env.GlobalAlloc    = env.GetProcAddress(env.kernel32, "GlobalAlloc");
-        env.GlobalFree     = env.GetProcAddress(env.kernel32, "GlobalFree");
+    leanloader_kernel_init();
+    u32 refcnt = __atomic_load_n(&env.refcnt, __ATOMIC_RELAXED);
+    while (refcnt > 0) {
+        if (__atomic_compare_exchange_n(&env.refcnt, &refcnt, refcnt + 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            return refcnt + 1;
+    }
+    env.AcquireSRWLockExclusive(&env.lock);
+    if (__atomic_load_n(&env.refcnt, __ATOMIC_ACQUIRE) == 0) {
+        u64 ticks = LEANLOADER_TICKS();
         env.gdiplus        = env.LoadLibraryA("gdiplus.dll");
         if (env.gdiplus) {
             env.GdipStartup                = env.GetProcAddress(env.gdiplus, "GdiplusStartup");
             env.GdipShutdown               = env.GetProcAddress(env.gdiplus, "GdiplusShutdown");
             env.GdipCreateBitmapFromFile   = env.GetProcAddress(env.gdiplus, "GdipCreateBitmapFromFile");
+            env.GdipCreateBitmapFromStream = env.GetProcAddress(env.gdiplus, "GdipCreateBitmapFromStream");
+            env.GdipLoadImageFromFile      = env.GetProcAddress(env.gdiplus, "GdipLoadImageFromFile");
+            env.GdipGetImagePixelFormat    = env.GetProcAddress(env.gdiplus, "GdipGetImagePixelFormat");
             env.GdipDisposeImage           = env.GetProcAddress(env.gdiplus, "GdipDisposeImage");
             env.GdipGetImageWidth          = env.GetProcAddress(env.gdiplus, "GdipGetImageWidth");
             env.GdipGetImageHeight         = env.GetProcAddress(env.gdiplus, "GdipGetImageHeight");
             env.GdipBitmapLockBits         = env.GetProcAddress(env.gdiplus, "GdipBitmapLockBits");
             env.GdipBitmapUnlockBits       = env.GetProcAddress(env.gdiplus, "GdipBitmapUnlockBits");
+            env.GdipImageGetFrameDimensionsCount = env.GetProcAddress(env.gdiplus, "GdipImageGetFrameDimensionsCount");
+            env.GdipImageGetFrameDimensionsList = env.GetProcAddress(env.gdiplus, "GdipImageGetFrameDimensionsList");
+            env.GdipImageGetFrameCount     = env.GetProcAddress(env.gdiplus, "GdipImageGetFrameCount");
+            env.GdipImageSelectActiveFrame = env.GetProcAddress(env.gdiplus, "GdipImageSelectActiveFrame");
+            env.GdipGetPropertyItemSize    = env.GetProcAddress(env.gdiplus, "GdipGetPropertyItemSize");
+            env.GdipGetPropertyItem        = env.GetProcAddress(env.gdiplus, "GdipGetPropertyItem");
             GdiplusStartupInput input = {1, 0, 0, 0};
             u32 status = env.GdipStartup(&env.token, &input, 0);
             if (status == 0) {
-                env.refcnt++;
+                __atomic_store_n(&env.refcnt, 1, __ATOMIC_RELEASE);
+                LEANLOADER_COUNT(gdipstartups, 1);
             } else {
                 env.FreeLibrary(env.gdiplus);
+                LEANLOADER_COUNT(gdipfailures, 1);
             }
         }
+        LEANLOADER_COUNT(gdipticks, LEANLOADER_TICKS() - ticks);
     } else {
-        env.refcnt++;
+        __atomic_add_fetch(&env.refcnt, 1, __ATOMIC_ACQUIRE);
     }
-    return env.refcnt;
+    refcnt = __atomic_load_n(&env.refcnt, __ATOMIC_RELAXED);
+    env.ReleaseSRWLockExclusive(&env.lock);
+    return refcnt;
 }
 
 // an internal function to deinitialize the "runtime environment"
 static i32 leanloader_env_deinit() {
-    if (env.refcnt > 0) {
-        env.refcnt--;
-        if (env.refcnt == 0) {
+    u32 refcnt = __atomic_load_n(&env.refcnt, __ATOMIC_RELAXED);
+    while (refcnt > 1) {
+        if (__atomic_compare_exchange_n(&env.refcnt, &refcnt, refcnt - 1, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+            return refcnt - 1;
+    }
+    // we may be dropping the last reference
+    env.AcquireSRWLockExclusive(&env.lock);
+    refcnt = __atomic_load_n(&env.refcnt, __ATOMIC_ACQUIRE);
+    if (refcnt > 0) {
+        refcnt = __atomic_sub_fetch(&env.refcnt, 1, __ATOMIC_ACQ_REL);
+        if (refcnt == 0) {
             env.GdipShutdown(env.token);
             env.FreeLibrary(env.gdiplus);
         }
     }
-    return env.refcnt;
+    env.ReleaseSRWLockExclusive(&env.lock);
+    return refcnt;
 }
 
-// one of the two main functions, this one loads the image specified in the info struct
-i32 leanloader_load(leanloader_image_info* info) {
-    info->gpbitmap  = 0;
-    if (leanloader_env_init()) {
-        u32 status = env.GdipCreateBitmapFromFile(info->name, &info->gpbitmap);
-        if (status == 0) {
-            status = env.GdipGetImageWidth(info->gpbitmap, &info->bd.w);
-            if (status == 0) {
-                status = env.GdipGetImageHeight(info->gpbitmap, &info->bd.h);
-                if (status == 0) {
-                    u32 GPTR = 0x0040;
-                    // ensure that the bitmap data allocation size is a multiple of 64 bytes
-                    // this comes in handy when working with SIMD instructions up to AVX512 (specifically
-                    // the loop cleanup code is easier because we can wander off the end of the row)
-                    u32 allocSize = (info->bd.w * info->bd.h * 4) + 63 & ~63;
-                    info->bd.ptr = env.GlobalAlloc(GPTR, allocSize);
-                    if (info->bd.ptr) {
-                        u32 ImageLockModeRead           = 0x0001;
-                        u32 ImageLockModeWrite          = 0x0002;
-                        u32 ImageLockModeUserInputBuf   = 0x0004;
-                        u32 PixelFormat32bppARGB        = 0x0026200a;
-                        u32 flags = ImageLockModeRead | ImageLockModeWrite | ImageLockModeUserInputBuf;
-                        info->bd.PixelFormat = PixelFormat32bppARGB;
-                        info->bd.stride = info->bd.w * 4;
-                        Rect rect = {0, 0, info->bd.w, info->bd.h};
-                        status = env.GdipBitmapLockBits(info->gpbitmap, &rect, flags, PixelFormat32bppARGB, &info->bd);
-                        if (status == 0) {
-                            return 1;
-                        } else {
-                            env.GlobalFree(info->bd.ptr);
-                        }
-                    }
-                }
+// maps the whole file into memory, read-only or copy-on-write. returns the base of the
+// view (to be released with UnmapViewOfFile) or 0 on failure.
+static u8* leanloader_map(wchar* name, u64* size, u32 writecopy) {
+    u32 GENERIC_READ            = 0x80000000;
+    u32 FILE_SHARE_READ         = 0x00000001;
+    u32 OPEN_EXISTING           = 3;
+    u32 FILE_FLAG_SEQUENTIAL    = 0x08000000;
+    u32 PAGE_READONLY           = 0x02;
+    u32 PAGE_WRITECOPY          = 0x08;
+    u32 FILE_MAP_COPY           = 0x0001;
+    u32 FILE_MAP_READ           = 0x0004;
+    u8* view = 0;
+    u64 ticks = LEANLOADER_TICKS();
+    ptr file = env.CreateFileW(name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL, 0);
+    if (file != (ptr)-1) {
+        i64 filesize = 0;
+        // empty files can't be mapped, and wouldn't be images anyway
+        if (env.GetFileSizeEx(file, &filesize) && filesize > 0) {
+            ptr mapping = env.CreateFileMappingW(file, 0, writecopy ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, 0);
+            if (mapping) {
+                view = env.MapViewOfFile(mapping, writecopy ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+                *size = (u64)filesize;
+                LEANLOADER_COUNT(bytesread, view ? filesize : 0);
+                // the view keeps the mapping (and the file) alive on its own
+                env.CloseHandle(mapping);
             }
-            env.GdipDisposeImage(info->gpbitmap);
         }
+        env.CloseHandle(file);
     }
+    LEANLOADER_COUNT(ioticks, LEANLOADER_TICKS() - ticks);
+    return view;
+}
+
+static u16 leanloader_get16(u8* p) {
+    return (u16)(p[0] | p[1] << 8);
+}
+
+static u32 leanloader_get32(u8* p) {
+    return (u32)p[0] | (u32)p[1] << 8 | (u32)p[2] << 16 | (u32)p[3] << 24;
+}
+
+// the output format asked for
+static u32 leanloader_format(leanloader_image_info* info) {
+    return info->format ? info->format : LEANLOADER_FORMAT_ARGB;
+}
+
+// bytes per pixel of an output format, 0 for ones we don't know
+static u32 leanloader_format_bytes(u32 format) {
+    if (format == LEANLOADER_FORMAT_ARGB || format == LEANLOADER_FORMAT_PARGB)
+        return 4;
+    if (format == LEANLOADER_FORMAT_RGB24)
+        return 3;
+    if (format == LEANLOADER_FORMAT_ARGB64)
+        return 8;
+    if (format == LEANLOADER_FORMAT_GRAY8)
+        return 1;
     return 0;
 }
 
-// the other main function, this one frees the resources allocated by leanloader_load
-i32 leanloader_dispose(leanloader_image_info* info) {
-    if (info->gpbitmap) {
-        if (info->bd.ptr) {
-            env.GdipBitmapUnlockBits(info->gpbitmap, &info->bd);
-            env.GlobalFree(info->bd.ptr);
-            info->bd.ptr = 0;
+// whether the native decoders can produce the format
+static i32 leanloader_format_native(u32 format) {
+    return format != LEANLOADER_FORMAT_ARGB64 && leanloader_format_bytes(format) != 0;
+}
+
+// bytes per 4x4 block of a block compressed format, 0 for anything else
+static u32 leanloader_format_block(u32 format) {
+    if (format == LEANLOADER_FORMAT_BC1)
+        return 8;
+    if (format == LEANLOADER_FORMAT_BC3 || format == LEANLOADER_FORMAT_BC7)
+        return 16;
+    return 0;
+}
+
+// what a loaded image takes up, mips included, padding not
+static u64 leanloader_image_bytes(leanloader_image_info* info) {
+    if (info->mips)
+        return info->mip[info->mips - 1].offset + info->mip[info->mips - 1].size;
+    u32 rows = leanloader_format_block(info->bd.PixelFormat) ? (info->bd.h + 3) / 4 : info->bd.h;
+    return (u64)(info->bd.stride < 0 ? -info->bd.stride : info->bd.stride) * rows;
+}
+
+// c * a / 255 for the three color channels, rounded, two channels at a time
+static u32 leanloader_premultiply1(u32 p) {
+    u32 a = p >> 24;
+    if (a == 255)
+        return p;
+    u32 rb = (p & 0x00ff00ff) * a + 0x00800080;
+    u32 g  = (p & 0x0000ff00) * a + 0x00008000;
+    rb = (rb + (rb >> 8 & 0x00ff00ff)) >> 8 & 0x00ff00ff;
+    g  = (g + (g >> 8 & 0x0000ff00)) >> 8 & 0x0000ff00;
+    return a << 24 | rb | g;
+}
+
+// takes n ARGB pixels the rest of the way to the output format, in the same pass that
+// produced them. src and dst may be the same. rows narrower than 32bpp are padded with
+// zeroes to a multiple of 4 bytes, like GDI+ does.
+static void leanloader_pack(u32* src, u8* dst, u32 n, u32 format) {
+    if (format == LEANLOADER_FORMAT_PARGB) {
+        u32* out = (u32*)dst;
+        for (u32 i = 0; i < n; i++)
+            out[i] = leanloader_premultiply1(src[i]);
+    } else if (format == LEANLOADER_FORMAT_RGB24) {
+        u64 i = 0;
+        for (; i < n; i++) {
+            u32 p = src[i];
+            dst[i * 3]     = (u8)p;
+            dst[i * 3 + 1] = (u8)(p >> 8);
+            dst[i * 3 + 2] = (u8)(p >> 16);
         }
-        env.GdipDisposeImage(info->gpbitmap);
-        info->gpbitmap = 0;
+        for (i *= 3; i & 3; i++)
+            dst[i] = 0;
+    } else if (format == LEANLOADER_FORMAT_GRAY8) {
+        u64 i = 0;
+        for (; i < n; i++) {
+            u32 p = src[i];
+            // rec. 601 weights, in 8 bits of fraction
+            dst[i] = (u8)(((p >> 16 & 0xff) * 77 + (p >> 8 & 0xff) * 150 + (p & 0xff) * 29 + 128) >> 8);
+        }
+        for (; i & 3; i++)
+            dst[i] = 0;
     }
-    leanloader_env_deinit();
-    return 0;
 }
 
-#if _LEANLOADER_DEBUG
-#include <stdio.h>
-int main(int argc, char *argv[]) {
-    leanloader_image_info info;
-    info.name = u"test\\leanloader.png";
-    leanloader_load(&info);
-    leanloader_dispose(&info);
+// the native decoders write ARGB, so for narrower formats each row goes through a scratch
+// row first. so does premultiplying (which reads the row back) when the rows go to memory
+// of the caller's: that's often write-combined, and reading it is very slow.
+// sets *scratch (to 0 if none is needed), and returns 0 if it couldn't be had.
+static i32 leanloader_scratch_alloc(u32 format, u32 w, i32 writeonly, u32** scratch) {
+    u32 GMEM_FIXED = 0x0000;
+    *scratch = 0;
+    if (leanloader_format_bytes(format) >= 4 && !(writeonly && format == LEANLOADER_FORMAT_PARGB))
+        return 1;
+    *scratch = env.GlobalAlloc(GMEM_FIXED, (u64)w * 4 + 64);
+    return *scratch != 0;
+}
+
+// zeroes the gaps between mip levels, so every level is followed by zeroes up to the next
+// 64 bytes like the image itself
+static void leanloader_mips_clear(leanloader_image_info* info) {
+    for (u32 i = 1; i < info->mips; i++) {
+        u64 end = info->mip[i - 1].offset + info->mip[i - 1].size;
+        leanloader_fill((u8*)info->bd.ptr + end, 0, info->mip[i].offset - end);
+    }
+}
+
+// the mip kernels: one row of a level from two rows of the one above it. w is the width of
+// the new row and sw the width of the source rows; a source only 1 pixel wide is averaged
+// vertically. every 2x2 box is averaged with rounding, all four channels alike.
+typedef void (*leanloader_mip_kernel_t)(u32* out, u32* row0, u32* row1, u32 w, u32 sw);
+
+static void leanloader_mip_scalar(u32* out, u32* row0, u32* row1, u32 w, u32 sw) {
+    u32 dx = sw > 1;
+    for (u32 x = 0; x < w; x++) {
+        u32 a = row0[2 * x], b = row0[2 * x + dx], c = row1[2 * x], d = row1[2 * x + dx];
+        u32 lo = (a & 0x00ff00ff) + (b & 0x00ff00ff) + (c & 0x00ff00ff) + (d & 0x00ff00ff) + 0x00020002;
+        u32 hi = (a >> 8 & 0x00ff00ff) + (b >> 8 & 0x00ff00ff) + (c >> 8 & 0x00ff00ff) + (d >> 8 & 0x00ff00ff) + 0x00020002;
+        out[x] = (lo >> 2 & 0x00ff00ff) | (hi >> 2 & 0x00ff00ff) << 8;
+    }
+}
+
+// the same in linear light: colors go through the 16-bit tables, alpha is averaged as is
+static void leanloader_mip_srgb(u32* out, u32* row0, u32* row1, u32 w, u32 sw) {
+    u16* lin = leanloader_srgb_linear16;
+    u32 dx = sw > 1;
+    for (u32 x = 0; x < w; x++) {
+        u32 a = row0[2 * x], b = row0[2 * x + dx], c = row1[2 * x], d = row1[2 * x + dx];
+        u32 p = ((a >> 24) + (b >> 24) + (c >> 24) + (d >> 24) + 2) >> 2 << 24;
+        for (u32 shift = 0; shift < 24; shift += 8) {
+            u32 sum = lin[a >> shift & 0xff] + lin[b >> shift & 0xff] + lin[c >> shift & 0xff] + lin[d >> shift & 0xff];
+            p |= (u32)leanloader_linear16_srgb[(sum + 2) >> 2 >> 4] << shift;
+        }
+        out[x] = p;
+    }
+}
+
+#if defined(__SSE2__)
+// even and odd pixels are pulled apart with shuffle_ps, then the two channels sharing each
+// 16-bit half of a pixel are summed together (4 * 255 + 2 still fits)
+__attribute__((target("sse2")))
+static void leanloader_mip_sse2(u32* out, u32* row0, u32* row1, u32 w, u32 sw) {
+    if (sw < 2) {
+        leanloader_mip_scalar(out, row0, row1, w, sw);
+        return;
+    }
+    __m128i m = _mm_set1_epi32(0x00ff00ff);
+    __m128i two = _mm_set1_epi16(2);
+    u32 x = 0;
+    for (; x + 4 <= w; x += 4) {
+        __m128i a0 = _mm_loadu_si128((__m128i*)(row0 + 2 * x));
+        __m128i a1 = _mm_loadu_si128((__m128i*)(row0 + 2 * x + 4));
+        __m128i c0 = _mm_loadu_si128((__m128i*)(row1 + 2 * x));
+        __m128i c1 = _mm_loadu_si128((__m128i*)(row1 + 2 * x + 4));
+        __m128i lo0 = _mm_add_epi16(_mm_and_si128(a0, m), _mm_and_si128(c0, m));
+        __m128i lo1 = _mm_add_epi16(_mm_and_si128(a1, m), _mm_and_si128(c1, m));
+        __m128i hi0 = _mm_add_epi16(_mm_and_si128(_mm_srli_epi32(a0, 8), m), _mm_and_si128(_mm_srli_epi32(c0, 8), m));
+        __m128i hi1 = _mm_add_epi16(_mm_and_si128(_mm_srli_epi32(a1, 8), m), _mm_and_si128(_mm_srli_epi32(c1, 8), m));
+        __m128i lo = _mm_add_epi16(_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo0), _mm_castsi128_ps(lo1), 0x88)),
+                                   _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo0), _mm_castsi128_ps(lo1), 0xdd)));
+        __m128i hi = _mm_add_epi16(_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(hi0), _mm_castsi128_ps(hi1), 0x88)),
+                                   _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(hi0), _mm_castsi128_ps(hi1), 0xdd)));
+        lo = _mm_and_si128(_mm_srli_epi16(_mm_add_epi16(lo, two), 2), m);
+        hi = _mm_slli_epi32(_mm_and_si128(_mm_srli_epi16(_mm_add_epi16(hi, two), 2), m), 8);
+        _mm_storeu_si128((__m128i*)(out + x), _mm_or_si128(lo, hi));
+    }
+    leanloader_mip_scalar(out + x, row0 + 2 * x, row1 + 2 * x, w - x, sw);
+}
+
+// same as above; shuffle_ps works within 128-bit lanes, so a permute puts the pixels back in order
+__attribute__((target("avx2")))
+static void leanloader_mip_avx2(u32* out, u32* row0, u32* row1, u32 w, u32 sw) {
+    if (sw < 2) {
+        leanloader_mip_scalar(out, row0, row1, w, sw);
+        return;
+    }
+    __m256i m = _mm256_set1_epi32(0x00ff00ff);
+    __m256i two = _mm256_set1_epi16(2);
+    u32 x = 0;
+    for (; x + 8 <= w; x += 8) {
+        __m256i a0 = _mm256_loadu_si256((__m256i*)(row0 + 2 * x));
+        __m256i a1 = _mm256_loadu_si256((__m256i*)(row0 + 2 * x + 8));
+        __m256i c0 = _mm256_loadu_si256((__m256i*)(row1 + 2 * x));
+        __m256i c1 = _mm256_loadu_si256((__m256i*)(row1 + 2 * x + 8));
+        __m256i lo0 = _mm256_add_epi16(_mm256_and_si256(a0, m), _mm256_and_si256(c0, m));
+        __m256i lo1 = _mm256_add_epi16(_mm256_and_si256(a1, m), _mm256_and_si256(c1, m));
+        __m256i hi0 = _mm256_add_epi16(_mm256_and_si256(_mm256_srli_epi32(a0, 8), m), _mm256_and_si256(_mm256_srli_epi32(c0, 8), m));
+        __m256i hi1 = _mm256_add_epi16(_mm256_and_si256(_mm256_srli_epi32(a1, 8), m), _mm256_and_si256(_mm256_srli_epi32(c1, 8), m));
+        __m256i lo = _mm256_add_epi16(_mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(lo0), _mm256_castsi256_ps(lo1), 0x88)),
+                                      _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(lo0), _mm256_castsi256_ps(lo1), 0xdd)));
+        __m256i hi = _mm256_add_epi16(_mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(hi0), _mm256_castsi256_ps(hi1), 0x88)),
+                                      _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(hi0), _mm256_castsi256_ps(hi1), 0xdd)));
+        lo = _mm256_and_si256(_mm256_srli_epi16(_mm256_add_epi16(lo, two), 2), m);
+        hi = _mm256_slli_epi32(_mm256_and_si256(_mm256_srli_epi16(_mm256_add_epi16(hi, two), 2), m), 8);
+        _mm256_storeu_si256((__m256i*)(out + x), _mm256_permute4x64_epi64(_mm256_or_si256(lo, hi), 0xd8));
+    }
+    leanloader_mip_scalar(out + x, row0 + 2 * x, row1 + 2 * x, w - x, sw);
+}
+#else
+#define leanloader_mip_sse2     leanloader_mip_scalar
+#define leanloader_mip_avx2     leanloader_mip_scalar
+#endif
+
+// indexed by LEANLOADER_CPU_*; AVX-512 wouldn't buy much over AVX2 for something this memory bound
+static leanloader_mip_kernel_t leanloader_mip_kernels[4] = {
+    leanloader_mip_scalar, leanloader_mip_sse2, leanloader_mip_avx2, leanloader_mip_avx2};
+
+// called by the decoders as each row of the image is finished: builds every mip row that
+// can now be built, so each level is made from rows that are still in the cache
+static void leanloader_mips_row(leanloader_image_info* info, u32 y) {
+    leanloader_mip_kernel_t kernel = info->flags & LEANLOADER_MIPMAPS_SRGB ? leanloader_mip_srgb : leanloader_mip_kernels[env.cpu];
+    u8* base = info->bd.ptr;
+    u32 k = y;
+    for (u32 level = 1; level < info->mips; level++) {
+        leanloader_mip* src = &info->mip[level - 1];
+        leanloader_mip* dst = &info->mip[level];
+        u32 r = k / 2;
+        if (r >= dst->h)
+            return;
+        // the second source row, or the only one if the level above is a single row
+        u32 k1 = 2 * r + 1 < src->h ? 2 * r + 1 : src->h - 1;
+        if (k != k1)
+            return;
+        u32* row0 = (u32*)(base + src->offset + (u64)src->stride * (2 * r));
+        u32* row1 = (u32*)(base + src->offset + (u64)src->stride * k1);
+        kernel((u32*)(base + dst->offset + (u64)dst->stride * r), row0, row1, dst->w, src->w);
+        k = r;
+    }
+}
+
+// the whole chain at once, for images that didn't come in row by row
+static void leanloader_mips_build(leanloader_image_info* info) {
+    if (info->mips > 1) {
+        for (u32 y = 0; y < info->bd.h; y++)
+            leanloader_mips_row(info, y);
+    }
+}
+
+// buffers disposed of while the pool is on wait here, on one list per bucket, for the next
+// load that needs exactly as many bytes. the link lives in the first bytes of the buffer.
+typedef struct leanloader_pooled {
+    struct leanloader_pooled* next;
+    u64 size;
+} leanloader_pooled;
+
+#define LEANLOADER_POOL_BUCKETS 64
+
+typedef struct {
+    ptr lock;           // SRWLOCK
+    u64 budget;         // most bytes to keep around, 0 when the pool is off
+    u64 bytes;          // bytes on the lists
+    leanloader_pooled* buckets[LEANLOADER_POOL_BUCKETS];
+} leanloader_pool_state;
+
+static leanloader_pool_state pool = {0};
+
+// allocation sizes are multiples of 64, so the low bits carry nothing
+static u32 leanloader_pool_bucket(u64 size) {
+    return (u32)(size >> 6 ^ size >> 18) % LEANLOADER_POOL_BUCKETS;
+}
+
+// a pooled buffer of exactly size bytes, or 0
+static ptr leanloader_pool_get(u64 size) {
+    leanloader_pooled* p = 0;
+    env.AcquireSRWLockExclusive(&pool.lock);
+    for (leanloader_pooled** link = &pool.buckets[leanloader_pool_bucket(size)]; *link; link = &(*link)->next) {
+        if ((*link)->size == size) {
+            p = *link;
+            *link = p->next;
+            pool.bytes -= size;
+            break;
+        }
+    }
+    env.ReleaseSRWLockExclusive(&pool.lock);
+    return p;
+}
+
+// keeps the buffer for later if that fits the budget, otherwise frees it
+static void leanloader_pool_put(ptr buffer, u64 size) {
+    leanloader_pooled* p = buffer;
+    env.AcquireSRWLockExclusive(&pool.lock);
+    if (pool.bytes + size <= pool.budget) {
+        u32 bucket = leanloader_pool_bucket(size);
+        p->next = pool.buckets[bucket];
+        p->size = size;
+        pool.buckets[bucket] = p;
+        pool.bytes += size;
+        p = 0;
+    }
+    env.ReleaseSRWLockExclusive(&pool.lock);
+    if (p)
+        env.GlobalFree(p);
+}
+
+// allocates the buffer for size bytes of pixels, from wherever the hooks and flags say, and
+// points bd.ptr at it
+static i32 leanloader_alloc_buffer(leanloader_image_info* info, u64 size) {
+    // ensure that the bitmap data allocation size is a multiple of 64 bytes
+    // this comes in handy when working with SIMD instructions up to AVX512 (specifically
+    // the loop cleanup code is easier because we can wander off the end of the row)
+    u64 allocSize = size + 63 & ~(u64)63;
+    u64 ticks = LEANLOADER_TICKS();
+    i32 reused = 0;
+    info->bd.ptr = 0;
+    if (env.alloc) {
+        info->bd.ptr = env.alloc(allocSize, env.allocdata);
+        info->storage = LEANLOADER_STORAGE_HOOK;
+    } else {
+        // large pages need the "lock pages in memory" privilege enabled in the process token.
+        // if it isn't, VirtualAlloc just fails and we go on to GlobalAlloc.
+        if ((info->flags & LEANLOADER_LARGE_PAGES) && env.largepage && allocSize >= env.largepage) {
+            u32 MEM_COMMIT          = 0x00001000;
+            u32 MEM_RESERVE         = 0x00002000;
+            u32 MEM_LARGE_PAGES     = 0x20000000;
+            u32 PAGE_READWRITE      = 0x04;
+            u64 pages = allocSize + env.largepage - 1 & ~(env.largepage - 1);
+            info->bd.ptr = env.VirtualAlloc(0, pages, MEM_COMMIT | MEM_RESERVE | MEM_LARGE_PAGES, PAGE_READWRITE);
+            info->storage = LEANLOADER_STORAGE_VIRTUAL;
+        }
+        if (info->bd.ptr == 0) {
+            // with the pool on, GlobalAlloc buffers come from it when it has one this size,
+            // and are tagged so dispose hands them back to it
+            i32 pooled = __atomic_load_n(&pool.budget, __ATOMIC_RELAXED) != 0;
+            if (pooled)
+                info->bd.ptr = leanloader_pool_get(allocSize);
+            reused = info->bd.ptr != 0;
+            if (!reused) {
+                // no GPTR, every pixel gets written anyway
+                u32 GMEM_FIXED = 0x0000;
+                info->bd.ptr = env.GlobalAlloc(GMEM_FIXED, allocSize);
+            }
+            info->storage = pooled ? LEANLOADER_STORAGE_POOL : LEANLOADER_STORAGE_GLOBAL;
+            info->allocsize = allocSize;
+        }
+    }
+    if (info->bd.ptr == 0) {
+        info->error = LEANLOADER_ERROR_MEMORY;
+        return 0;
+    }
+    // the padding past the last pixel reads as zeroes, like it always has
+    leanloader_fill((u8*)info->bd.ptr + size, 0, allocSize - size);
+    LEANLOADER_COUNT(poolhits, reused);
+    LEANLOADER_COUNT(allocs, !reused);
+    LEANLOADER_COUNT(allocbytes, reused ? 0 : allocSize);
+    LEANLOADER_COUNT(allocticks, LEANLOADER_TICKS() - ticks);
+    return 1;
+}
+
+// sets up the buffer for a w x h image: the caller's, if there is one (and it's big enough),
+// or one from the allocator hooks, large pages, the buffer pool or GlobalAlloc. fills in
+// bd.ptr, bd.stride and bd.PixelFormat.
+static i32 leanloader_alloc_pixels(leanloader_image_info* info, u32 w, u32 h) {
+    u32 format = leanloader_format(info);
+    u32 bytes = leanloader_format_bytes(format);
+    u64 rowbytes = (u64)w * bytes + 3 & ~(u64)3;
+    // strides are 32-bit, in GDI+ too
+    if (bytes == 0 || rowbytes > 0x7fffffff) {
+        info->error = bytes ? LEANLOADER_ERROR_TOO_BIG : LEANLOADER_ERROR_UNSUPPORTED;
+        return 0;
+    }
+    info->bd.PixelFormat = format;
+    u64 stride = info->dst && info->dststride ? (u64)info->dststride : rowbytes;
+    if ((info->dst && info->dststride < 0) || stride < rowbytes) {
+        info->error = LEANLOADER_ERROR_DST;
+        return 0;
+    }
+    u64 size = stride * (h - 1) + rowbytes;
+    // the mip levels follow the image, 64-byte aligned, down to 1x1
+    info->mips = 0;
+    if (info->flags & (LEANLOADER_MIPMAPS | LEANLOADER_MIPMAPS_SRGB)) {
+        if (bytes != 4) {
+            info->error = LEANLOADER_ERROR_UNSUPPORTED;
+            return 0;
+        }
+        leanloader_mip* mip = info->mip;
+        mip[0].offset = 0;
+        mip[0].size = size;
+        mip[0].w = w;
+        mip[0].h = h;
+        mip[0].stride = (i32)stride;
+        u32 n = 1;
+        while (mip[n - 1].w > 1 || mip[n - 1].h > 1) {
+            mip[n].offset = mip[n - 1].offset + mip[n - 1].size + 63 & ~(u64)63;
+            mip[n].w = mip[n - 1].w > 1 ? mip[n - 1].w / 2 : 1;
+            mip[n].h = mip[n - 1].h > 1 ? mip[n - 1].h / 2 : 1;
+            mip[n].stride = (i32)(mip[n].w * 4);
+            mip[n].size = (u64)mip[n].w * 4 * mip[n].h;
+            n++;
+        }
+        info->mips = n;
+        size = mip[n - 1].offset + mip[n - 1].size;
+    }
+    if (info->dst) {
+        if (size > info->dstsize) {
+            info->error = LEANLOADER_ERROR_DST;
+            return 0;
+        }
+        info->bd.ptr = info->dst;
+        info->bd.stride = (i32)stride;
+        info->storage = LEANLOADER_STORAGE_CALLER;
+        leanloader_mips_clear(info);
+        return 1;
+    }
+    if (!leanloader_alloc_buffer(info, size))
+        return 0;
+    info->bd.stride = (i32)rowbytes;
+    leanloader_mips_clear(info);
+    return 1;
+}
+
+static void leanloader_cache_release(ptr entry);
+
+// hands whatever pixel buffer the struct holds back to where it came from
+static void leanloader_free_pixels(leanloader_image_info* info) {
+    if (info->bd.ptr) {
+        if (info->storage == LEANLOADER_STORAGE_CACHE)
+            leanloader_cache_release(info->cache);
+        else if (info->storage == LEANLOADER_STORAGE_VIEW)
+            env.UnmapViewOfFile(info->view);
+        else if (info->storage == LEANLOADER_STORAGE_HOOK)
+            env.free(info->bd.ptr, env.allocdata);
+        else if (info->storage == LEANLOADER_STORAGE_VIRTUAL)
+            env.VirtualFree(info->bd.ptr, 0, 0x8000);   // MEM_RELEASE
+        else if (info->storage == LEANLOADER_STORAGE_POOL)
+            leanloader_pool_put(info->bd.ptr, info->allocsize);
+        else if (info->storage == LEANLOADER_STORAGE_GLOBAL)
+            env.GlobalFree(info->bd.ptr);
+        info->bd.ptr = 0;
+        info->view = 0;
+        info->cache = 0;
+        info->storage = LEANLOADER_STORAGE_GLOBAL;
+    }
+}
+
+// the parts of a BMP header the native decoder cares about
+typedef struct {
+    u8* pixels;         // the first row stored in the file
+    u32 w;
+    u32 h;
+    u32 topdown;
+    u32 alphamask;      // 0 if the fourth byte is padding
+} leanloader_bmp;
+
+// the native BMP path: uncompressed 32bpp (BI_RGB, or BI_BITFIELDS/BI_ALPHABITFIELDS with the
+// usual BGRA masks.) anything else returns 0 and is left for GDI+ to deal with. data/size
+// is the whole file.
+static i32 leanloader_bmp_open(leanloader_bmp* bmp, u8* data, u64 size) {
+    if (size < 54 || data[0] != 'B' || data[1] != 'M')
+        return 0;
+    u32 offset      = leanloader_get32(data + 10);
+    u32 hdrsize     = leanloader_get32(data + 14);
+    i32 w           = (i32)leanloader_get32(data + 18);
+    i32 h           = (i32)leanloader_get32(data + 22);
+    u32 planes      = leanloader_get16(data + 26);
+    u32 bpp         = leanloader_get16(data + 28);
+    u32 compression = leanloader_get32(data + 30);
+    u32 BI_RGB = 0, BI_BITFIELDS = 3, BI_ALPHABITFIELDS = 6;
+    // OS/2 headers (12 bytes) lay things out differently, and are never 32bpp anyway
+    if (hdrsize < 40 || (u64)hdrsize + 14 > size || planes != 1 || bpp != 32)
+        return 0;
+    if (compression != BI_RGB && compression != BI_BITFIELDS && compression != BI_ALPHABITFIELDS)
+        return 0;
+    u32 topdown = h < 0;
+    if (topdown)
+        h = -h;
+    // strides are 32-bit
+    if (w <= 0 || h <= 0 || w > 0x1fffffff)
+        return 0;
+    // alpha is only honored if a mask says it's there; GDI+ treats plain BI_RGB as 32bppRGB,
+    // where the fourth byte is padding. the masks are part of V4+ headers, or follow a
+    // basic 40-byte header when BI_BITFIELDS/BI_ALPHABITFIELDS is used.
+    u32 alphamask = 0;
+    if (compression != BI_RGB) {
+        u8* masks = data + 54;
+        u32 nmasks = compression == BI_ALPHABITFIELDS || hdrsize >= 56 ? 4 : 3;
+        if (hdrsize == 40 && (u64)54 + nmasks * 4 > size)
+            return 0;
+        if (leanloader_get32(masks) != 0x00ff0000 || leanloader_get32(masks + 4) != 0x0000ff00 ||
+            leanloader_get32(masks + 8) != 0x000000ff)
+            return 0;
+        alphamask = nmasks == 4 ? leanloader_get32(masks + 12) : 0;
+        if (alphamask != 0 && alphamask != 0xff000000)
+            return 0;
+    }
+    if ((u64)offset + (u64)w * (u64)h * 4 > size)
+        return 0;
+    bmp->pixels     = data + offset;
+    bmp->w          = (u32)w;
+    bmp->h          = (u32)h;
+    bmp->topdown    = topdown;
+    bmp->alphamask  = alphamask;
+    return 1;
+}
+
+// copies n pixels with alpha forced to 255, for BMPs whose fourth byte is padding. the
+// source rows come straight out of the file, so they're not necessarily aligned, and the
+// destination may be the caller's, so neither end can be overrun.
+typedef void (*leanloader_opaque_kernel_t)(u32* dst, u8* src, u32 n);
+
+static void leanloader_opaque_scalar(u32* dst, u8* src, u32 n) {
+    leanloader_u32u* p = (leanloader_u32u*)src;
+    for (u32 x = 0; x < n; x++)
+        dst[x] = p[x] | 0xff000000;
+}
+
+#if defined(__SSE2__)
+__attribute__((target("sse2")))
+static void leanloader_opaque_sse2(u32* dst, u8* src, u32 n) {
+    __m128i alpha = _mm_set1_epi32(0xff000000);
+    u32 x = 0;
+    for (; x + 4 <= n; x += 4)
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(_mm_loadu_si128((__m128i*)(src + x * 4)), alpha));
+    leanloader_opaque_scalar(dst + x, src + x * 4, n - x);
+}
+
+__attribute__((target("avx2")))
+static void leanloader_opaque_avx2(u32* dst, u8* src, u32 n) {
+    __m256i alpha = _mm256_set1_epi32(0xff000000);
+    u32 x = 0;
+    for (; x + 8 <= n; x += 8)
+        _mm256_storeu_si256((__m256i*)(dst + x), _mm256_or_si256(_mm256_loadu_si256((__m256i*)(src + x * 4)), alpha));
+    leanloader_opaque_sse2(dst + x, src + x * 4, n - x);
+}
+
+// the tail is a masked load and store, so nothing past n is touched
+__attribute__((target("avx512f,avx512bw")))
+static void leanloader_opaque_avx512(u32* dst, u8* src, u32 n) {
+    __m512i alpha = _mm512_set1_epi32(0xff000000);
+    u32 x = 0;
+    for (; x + 16 <= n; x += 16)
+        _mm512_storeu_si512((__m512i*)(dst + x), _mm512_or_si512(_mm512_loadu_si512((__m512i*)(src + x * 4)), alpha));
+    if (x < n) {
+        __mmask16 m = (__mmask16)((1u << (n - x)) - 1);
+        _mm512_mask_storeu_epi32(dst + x, m, _mm512_or_si512(_mm512_maskz_loadu_epi32(m, src + x * 4), alpha));
+    }
 }
+#else
+#define leanloader_opaque_sse2      leanloader_opaque_scalar
+#define leanloader_opaque_avx2      leanloader_opaque_scalar
+#define leanloader_opaque_avx512    leanloader_opaque_scalar
 #endif
+
+// indexed by LEANLOADER_CPU_*
+static leanloader_opaque_kernel_t leanloader_opaque_kernels[4] = {
+    leanloader_opaque_scalar, leanloader_opaque_sse2, leanloader_opaque_avx2, leanloader_opaque_avx512};
+
+// copies n pixels of row y (counting from the top), starting at pixel x0, filling in alpha
+// where there is none
+static void leanloader_bmp_copy(leanloader_bmp* bmp, u32 y, u32 x0, u32 n, u32* dst) {
+    u64 row = bmp->topdown ? y : bmp->h - 1 - y;
+    u8* src = bmp->pixels + ((u64)bmp->w * row + x0) * 4;
+    if (bmp->alphamask)
+        leanloader_copy(dst, src, (u64)n * 4);
+    else
+        leanloader_opaque_kernels[env.cpu](dst, src, n);
+}
+
+// decodes a whole BMP. if view is nonzero, it's the writecopy mapping data lives in, and it may
+// be adopted as the pixel buffer (info->storage is set to LEANLOADER_STORAGE_VIEW if it is.)
+static i32 leanloader_bmp_decode(leanloader_image_info* info, u8* data, u64 size, u8* view) {
+    leanloader_bmp bmp;
+    if (!leanloader_bmp_open(&bmp, data, size))
+        return 0;
+    u64 rowbytes = (u64)bmp.w * 4;
+    u64 allocSize = rowbytes * bmp.h + 63 & ~(u64)63;
+    u32 format = leanloader_format(info);
+    info->bd.w = bmp.w;
+    info->bd.h = bmp.h;
+    // if the pixels can be used as they are, and the padding past the last pixel reads as
+    // zeroes, hand out the view. the padding has to be inside the mapped pages, where the
+    // tail of the last page past the end of the file is zeroes, but whatever the file has
+    // after the pixels (an ICC profile, say) is in the way, unless it's zeroes too
+    u64 mappedSize = size + 4095 & ~(u64)4095;
+    u64 offset = (u64)(bmp.pixels - data);
+    u32 padded = offset + allocSize <= mappedSize;
+    for (u64 i = offset + rowbytes * bmp.h; padded && i < size && i < offset + allocSize; i++)
+        padded = data[i] == 0;
+    u32 mipmaps = info->flags & (LEANLOADER_MIPMAPS | LEANLOADER_MIPMAPS_SRGB);
+    if (view && !info->dst && !mipmaps && format == LEANLOADER_FORMAT_ARGB && bmp.topdown && bmp.alphamask && padded) {
+        info->bd.stride = (i32)rowbytes;
+        info->bd.PixelFormat = format;
+        info->bd.ptr = bmp.pixels;
+        info->storage = LEANLOADER_STORAGE_VIEW;
+        info->view = view;
+        return 1;
+    }
+    u32* scratch;
+    if (!leanloader_scratch_alloc(format, bmp.w, info->dst != 0, &scratch))
+        return 0;
+    if (!leanloader_alloc_pixels(info, bmp.w, bmp.h)) {
+        if (scratch)
+            env.GlobalFree(scratch);
+        return 0;
+    }
+    // a single pass, flipping bottom-up files and filling in alpha where there is none
+    for (u32 y = 0; y < bmp.h; y++) {
+        u8* dst = (u8*)info->bd.ptr + (u64)info->bd.stride * y;
+        u32* argb = scratch ? scratch : (u32*)dst;
+        leanloader_bmp_copy(&bmp, y, 0, bmp.w, argb);
+        leanloader_pack(argb, dst, bmp.w, format);
+        if (info->mips)
+            leanloader_mips_row(info, y);
+    }
+    if (scratch)
+        env.GlobalFree(scratch);
+    return 1;
+}
+
+// the native PNG path, in three parts: an inflater that streams the zlib data straight out
+// of the IDAT chunks, the scanline unfilters, and the conversion to 32bpp ARGB. rows are
+// decoded one at a time through a small sliding window, so apart from the output buffer the
+// working set is the 32k deflate history plus a couple of rows.
+
+#define LEANLOADER_ZFAST_BITS   10
+#define LEANLOADER_ZFAST_MASK   ((1 << LEANLOADER_ZFAST_BITS) - 1)
+// a match can run up to 258 bytes past the point where we asked the inflater to stop, and
+// match copies move 8 bytes at a time, so this much room has to be left at the end of the window
+#define LEANLOADER_ZSLACK       (258 + 8)
+
+typedef struct {
+    u16 fast[1 << LEANLOADER_ZFAST_BITS];   // (code length << 9) | symbol, 0 means take the slow path
+    u16 firstcode[16];
+    u32 maxcode[17];
+    u16 firstsymbol[16];
+    u8  size[288];
+    u16 value[288];
+} leanloader_huffman;
+
+typedef struct {
+    u8* in;             // the IDAT chunk we're reading from
+    u8* inend;
+    u8* next;           // the chunk after it
+    u8* end;            // end of the file
+    u64 bits;           // bit buffer, lsb first
+    u32 nbits;
+    u32 overrun;        // bytes of zeroes handed out past the end of the data
+    u32 final;          // the current block is the last one
+    u32 type;           // current block type: 0 stored, 1 fixed, 2 dynamic, 3 between blocks
+    u32 stored;         // bytes left in a stored block
+    u32 done;           // the final block has ended (or stop was reached)
+    u64 consumed;       // bytes taken from the chunks so far, the bit buffer included
+    u64 stop;           // where to stop, in bytes into the IDAT data, if nonzero; see leanloader_png_parallel
+    leanloader_huffman lit;
+    leanloader_huffman dist;
+} leanloader_inflate;
+
+static u32 leanloader_get32be(u8* p) {
+    return (u32)p[0] << 24 | (u32)p[1] << 16 | (u32)p[2] << 8 | (u32)p[3];
+}
+
+// moves the inflater on to the next IDAT chunk; they have to be consecutive, so anything
+// else means the compressed data is over
+static i32 leanloader_znextidat(leanloader_inflate* z) {
+    while (z->next + 12 <= z->end) {
+        u8* chunk = z->next;
+        u32 len = leanloader_get32be(chunk);
+        if (leanloader_get32be(chunk + 4) != 0x49444154 || len > (u64)(z->end - chunk) - 12)
+            return 0;
+        z->in = chunk + 8;
+        z->inend = z->in + len;
+        z->next = z->inend + 4;
+        if (len)
+            return 1;
+    }
+    return 0;
+}
+
+// tops the bit buffer up to at least 56 bits, this covers any single symbol with its extra bits
+static void leanloader_zrefill(leanloader_inflate* z) {
+    if (z->inend - z->in >= 8) {
+        u64 v = *(leanloader_u64u*)z->in;
+        z->bits |= v << z->nbits;
+        u32 n = (63 - z->nbits) >> 3;
+        z->in += n;
+        z->consumed += n;
+        z->nbits += n * 8;
+        z->bits &= ((u64)1 << z->nbits) - 1;
+        return;
+    }
+    while (z->nbits <= 56) {
+        if (z->in >= z->inend && !leanloader_znextidat(z)) {
+            // pad with zeroes; the caller bails out if it actually starts eating them
+            z->overrun++;
+            z->nbits += 8;
+            continue;
+        }
+        z->bits |= (u64)*z->in++ << z->nbits;
+        z->consumed++;
+        z->nbits += 8;
+    }
+}
+
+static u32 leanloader_zget(leanloader_inflate* z, u32 n) {
+    u32 v = (u32)(z->bits & (((u64)1 << n) - 1));
+    z->bits >>= n;
+    z->nbits -= n;
+    return v;
+}
+
+static u32 leanloader_bitreverse16(u32 n) {
+    n = (n & 0xaaaa) >> 1 | (n & 0x5555) << 1;
+    n = (n & 0xcccc) >> 2 | (n & 0x3333) << 2;
+    n = (n & 0xf0f0) >> 4 | (n & 0x0f0f) << 4;
+    n = (n & 0xff00) >> 8 | (n & 0x00ff) << 8;
+    return n;
+}
+
+// builds the canonical huffman decoding tables from a list of code lengths
+static i32 leanloader_huffman_build(leanloader_huffman* h, u8* lengths, u32 num) {
+    u32 counts[16], next[16];
+    leanloader_fill(counts, 0, sizeof(counts));
+    leanloader_fill(h->fast, 0, sizeof(h->fast));
+    for (u32 i = 0; i < num; i++)
+        counts[lengths[i]]++;
+    counts[0] = 0;
+    u32 code = 0, k = 0;
+    for (u32 i = 1; i < 16; i++) {
+        next[i] = code;
+        h->firstcode[i] = (u16)code;
+        h->firstsymbol[i] = (u16)k;
+        code += counts[i];
+        // over-subscribed
+        if (counts[i] && code - 1 >= (1u << i))
+            return 0;
+        h->maxcode[i] = code << (16 - i);
+        code <<= 1;
+        k += counts[i];
+    }
+    h->maxcode[16] = 0x10000;
+    for (u32 i = 0; i < num; i++) {
+        u32 s = lengths[i];
+        if (s) {
+            u32 c = next[s] - h->firstcode[s] + h->firstsymbol[s];
+            h->size[c] = (u8)s;
+            h->value[c] = (u16)i;
+            if (s <= LEANLOADER_ZFAST_BITS) {
+                u32 j = leanloader_bitreverse16(next[s]) >> (16 - s);
+                while (j < (1 << LEANLOADER_ZFAST_BITS)) {
+                    h->fast[j] = (u16)(s << 9 | i);
+                    j += 1 << s;
+                }
+            }
+            next[s]++;
+        }
+    }
+    return 1;
+}
+
+// decodes one symbol; the bit buffer has to hold at least 16 bits
+static i32 leanloader_huffman_decode(leanloader_inflate* z, leanloader_huffman* h) {
+    u32 e = h->fast[z->bits & LEANLOADER_ZFAST_MASK];
+    if (e) {
+        leanloader_zget(z, e >> 9);
+        return e & 511;
+    }
+    u32 k = leanloader_bitreverse16((u32)z->bits & 0xffff);
+    u32 s = LEANLOADER_ZFAST_BITS + 1;
+    while (s < 16 && k >= h->maxcode[s])
+        s++;
+    if (s >= 16)
+        return -1;
+    u32 c = (k >> (16 - s)) - h->firstcode[s] + h->firstsymbol[s];
+    if (c >= 288 || h->size[c] != s)
+        return -1;
+    leanloader_zget(z, s);
+    return h->value[c];
+}
+
+static i32 leanloader_inflate_fixed(leanloader_inflate* z) {
+    u8 lengths[288 + 32];
+    u32 i = 0;
+    for (; i < 144; i++) lengths[i] = 8;
+    for (; i < 256; i++) lengths[i] = 9;
+    for (; i < 280; i++) lengths[i] = 7;
+    for (; i < 288; i++) lengths[i] = 8;
+    for (; i < 320; i++) lengths[i] = 5;
+    return leanloader_huffman_build(&z->lit, lengths, 288) && leanloader_huffman_build(&z->dist, lengths + 288, 32);
+}
+
+static i32 leanloader_inflate_dynamic(leanloader_inflate* z) {
+    static u8 order[19] = {16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15};
+    u8 lengths[286 + 32];
+    u8 codelengths[19];
+    leanloader_zrefill(z);
+    u32 hlit  = leanloader_zget(z, 5) + 257;
+    u32 hdist = leanloader_zget(z, 5) + 1;
+    u32 hclen = leanloader_zget(z, 4) + 4;
+    if (hlit > 286 || hdist > 30)
+        return 0;
+    leanloader_fill(codelengths, 0, sizeof(codelengths));
+    for (u32 i = 0; i < hclen; i++) {
+        leanloader_zrefill(z);
+        codelengths[order[i]] = (u8)leanloader_zget(z, 3);
+    }
+    // the code length code is built into the literal table, it gets rebuilt right after
+    if (!leanloader_huffman_build(&z->lit, codelengths, 19))
+        return 0;
+    u32 n = 0;
+    while (n < hlit + hdist) {
+        leanloader_zrefill(z);
+        i32 c = leanloader_huffman_decode(z, &z->lit);
+        u32 fill = 0, count = 0;
+        if (c < 0 || c > 18) {
+            return 0;
+        } else if (c < 16) {
+            lengths[n++] = (u8)c;
+            continue;
+        } else if (c == 16) {
+            if (n == 0)
+                return 0;
+            fill = lengths[n - 1];
+            count = 3 + leanloader_zget(z, 2);
+        } else if (c == 17) {
+            count = 3 + leanloader_zget(z, 3);
+        } else {
+            count = 11 + leanloader_zget(z, 7);
+        }
+        if (n + count > hlit + hdist)
+            return 0;
+        leanloader_fill(lengths + n, (u8)fill, count);
+        n += count;
+    }
+    // a block without an end-of-block code can't be decoded
+    if (lengths[256] == 0 || z->overrun > 16)
+        return 0;
+    return leanloader_huffman_build(&z->lit, lengths, hlit) && leanloader_huffman_build(&z->dist, lengths + hlit, hdist);
+}
+
+// inflates into out until it reaches target (or the stream ends), and returns where it got
+// to, or 0 on corrupt data. base is where the history in the output starts: anything
+// between base and out may be referenced by a match.
+static u8* leanloader_inflate_run(leanloader_inflate* z, u8* out, u8* base, u8* target) {
+    static u16 lbase[29]  = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                             35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+    static u8  lextra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                             3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+    static u16 dbase[30]  = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                             257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+    static u8  dextra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                             7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+    while (out < target) {
+        if (z->type == 3) {
+            // the end of a segment has to be right where a block starts, on a byte boundary
+            if (z->stop && z->consumed - z->nbits / 8 >= z->stop) {
+                if (z->consumed - z->nbits / 8 != z->stop || (z->nbits & 7))
+                    return 0;
+                z->done = 1;
+                return out;
+            }
+            if (z->final) {
+                z->done = 1;
+                return out;
+            }
+            leanloader_zrefill(z);
+            z->final = leanloader_zget(z, 1);
+            z->type = leanloader_zget(z, 2);
+            if (z->type == 0) {
+                leanloader_zget(z, z->nbits & 7);
+                u32 len = leanloader_zget(z, 16);
+                u32 nlen = leanloader_zget(z, 16);
+                if ((len ^ 0xffff) != nlen)
+                    return 0;
+                z->stored = len;
+            } else if (z->type == 1) {
+                if (!leanloader_inflate_fixed(z))
+                    return 0;
+            } else if (z->type == 2) {
+                if (!leanloader_inflate_dynamic(z))
+                    return 0;
+            } else {
+                return 0;
+            }
+            if (z->overrun > 16)
+                return 0;
+        }
+        if (z->type == 0) {
+            // whatever is left in the bit buffer first (we're byte aligned here), then straight from the chunks
+            while (z->stored && out < target && z->nbits >= 8) {
+                *out++ = (u8)leanloader_zget(z, 8);
+                z->stored--;
+            }
+            while (z->stored && out < target) {
+                if (z->in >= z->inend && !leanloader_znextidat(z))
+                    return 0;
+                u64 n = z->stored;
+                if (n > (u64)(target - out))
+                    n = (u64)(target - out);
+                if (n > (u64)(z->inend - z->in))
+                    n = (u64)(z->inend - z->in);
+                leanloader_copy(out, z->in, n);
+                out += n;
+                z->in += n;
+                z->consumed += n;
+                z->stored -= (u32)n;
+            }
+            if (z->stored == 0)
+                z->type = 3;
+            continue;
+        }
+        while (out < target) {
+            leanloader_zrefill(z);
+            if (z->overrun > 16)
+                return 0;
+            i32 sym = leanloader_huffman_decode(z, &z->lit);
+            if (sym < 256) {
+                if (sym < 0)
+                    return 0;
+                *out++ = (u8)sym;
+                continue;
+            }
+            if (sym == 256) {
+                z->type = 3;
+                break;
+            }
+            sym -= 257;
+            if (sym >= 29)
+                return 0;
+            u32 len = lbase[sym] + leanloader_zget(z, lextra[sym]);
+            i32 d = leanloader_huffman_decode(z, &z->dist);
+            if (d < 0 || d >= 30)
+                return 0;
+            u32 dist = dbase[d] + leanloader_zget(z, dextra[d]);
+            if (dist > (u64)(out - base))
+                return 0;
+            u8* src = out - dist;
+            u8* end = out + len;
+            if (dist >= 8) {
+                // may write up to 7 bytes past the end of the match, see LEANLOADER_ZSLACK
+                do {
+                    *(leanloader_u64u*)out = *(leanloader_u64u*)src;
+                    out += 8;
+                    src += 8;
+                } while (out < end);
+            } else {
+                do {
+                    *out++ = *src++;
+                } while (out < end);
+            }
+            out = end;
+        }
+    }
+    return out;
+}
+
+// the PNG decoder proper
+typedef struct {
+    u32 w;              // image dimensions
+    u32 h;
+    u32 depth;          // bits per sample
+    u32 color;          // PNG color type
+    u32 bpp;            // bytes per complete pixel, rounded up (this is what the filters work on)
+    u32 rowbytes;       // bytes per row, not counting the filter byte
+    u32 trns;           // nonzero if there's a tRNS color key (gray, RGB)
+    u16 key[3];         // the color key, at sample depth
+    u32 palette[256];   // ARGB, with the tRNS alpha applied
+    u32 y;              // number of rows decoded so far
+    u8* window;         // sliding window holding the inflated data, deflate history included
+    u8* winend;
+    u8* wpos;           // end of the inflated data in the window
+    u8* rpos;           // start of the next raw row in the window
+    u8* rows;           // the allocation holding the two row buffers below
+    u8* cur;            // the row we just unfiltered
+    u8* prev;           // the one before it
+    u8* idat;           // the first IDAT chunk
+    leanloader_inflate z;
+} leanloader_png;
+
+static u32 leanloader_paeth(u32 a, u32 b, u32 c) {
+    i32 p  = (i32)(a + b - c);
+    i32 pa = p > (i32)a ? p - (i32)a : (i32)a - p;
+    i32 pb = p > (i32)b ? p - (i32)b : (i32)b - p;
+    i32 pc = p > (i32)c ? p - (i32)c : (i32)c - p;
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// the unfilters, one row at a time. cur and prev both have at least 16 zero bytes in front
+// (that's the "pixel to the left" of the first one) and 64 bytes of slack after the row,
+// and raw can be read up to 64 bytes past its end, so the vector loops don't bother with tails.
+// filter 0 is a plain copy and never gets this far.
+typedef void (*leanloader_unfilter_kernel_t)(u32 filter, u8* cur, u8* raw, u8* prev, u32 n, u32 bpp);
+
+static void leanloader_unfilter_scalar(u32 filter, u8* cur, u8* raw, u8* prev, u32 n, u32 bpp) {
+    if (filter == 1) {
+        for (u32 i = 0; i < n; i++)
+            cur[i] = raw[i] + cur[(i32)i - (i32)bpp];
+    } else if (filter == 2) {
+        for (u32 i = 0; i < n; i++)
+            cur[i] = raw[i] + prev[i];
+    } else if (filter == 3) {
+        for (u32 i = 0; i < n; i++)
+            cur[i] = raw[i] + ((cur[(i32)i - (i32)bpp] + prev[i]) >> 1);
+    } else {
+        for (u32 i = 0; i < n; i++)
+            cur[i] = raw[i] + leanloader_paeth(cur[(i32)i - (i32)bpp], prev[i], prev[(i32)i - (i32)bpp]);
+    }
+}
+
+#if defined(__SSE2__)
+// sub, average and paeth depend on the pixel to the left, so short of the prefix sum
+// trick for sub, the best we can do is a whole pixel per step. only 3 and 4 byte pixels
+// (8-bit RGB and RGBA) get this treatment, they're what almost everything is. the wider
+// levels only change up, the one filter that is a straight vector add.
+__attribute__((target("sse2")))
+static void leanloader_unfilter_sse2(u32 filter, u8* cur, u8* raw, u8* prev, u32 n, u32 bpp) {
+    if (filter == 2) {
+        for (u32 i = 0; i < n; i += 16) {
+            __m128i x = _mm_loadu_si128((__m128i*)(raw + i));
+            __m128i b = _mm_loadu_si128((__m128i*)(prev + i));
+            _mm_storeu_si128((__m128i*)(cur + i), _mm_add_epi8(x, b));
+        }
+        return;
+    }
+    if (bpp != 4 && bpp != 3) {
+        leanloader_unfilter_scalar(filter, cur, raw, prev, n, bpp);
+        return;
+    }
+    __m128i zero = _mm_setzero_si128();
+    __m128i a = zero;
+    if (filter == 1 && bpp == 4) {
+        for (u32 i = 0; i < n; i += 16) {
+            __m128i x = _mm_loadu_si128((__m128i*)(raw + i));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+            x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+            x = _mm_add_epi8(x, a);
+            _mm_storeu_si128((__m128i*)(cur + i), x);
+            a = _mm_shuffle_epi32(x, 0xff);
+        }
+    } else if (filter == 1) {
+        for (u32 i = 0; i < n; i += bpp) {
+            a = _mm_add_epi8(a, _mm_cvtsi32_si128(*(leanloader_i32u*)(raw + i)));
+            *(leanloader_i32u*)(cur + i) = _mm_cvtsi128_si32(a);
+        }
+    } else if (filter == 3) {
+        __m128i one = _mm_set1_epi8(1);
+        for (u32 i = 0; i < n; i += bpp) {
+            __m128i b = _mm_cvtsi32_si128(*(leanloader_i32u*)(prev + i));
+            __m128i x = _mm_cvtsi32_si128(*(leanloader_i32u*)(raw + i));
+            // _mm_avg_epu8 rounds up, the filter wants it rounded down
+            __m128i avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), one));
+            a = _mm_add_epi8(x, avg);
+            *(leanloader_i32u*)(cur + i) = _mm_cvtsi128_si32(a);
+        }
+    } else {
+        // in 16-bit lanes: a is left, b is up, c is up-left. SSE2 has neither abs nor blendv,
+        // so it's max(x, -x) and and/andnot/or
+        __m128i c = zero;
+        __m128i mask = _mm_set1_epi16(0x00ff);
+        for (u32 i = 0; i < n; i += bpp) {
+            __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(leanloader_i32u*)(prev + i)), zero);
+            __m128i x = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(leanloader_i32u*)(raw + i)), zero);
+            __m128i pa = _mm_sub_epi16(b, c);
+            __m128i pb = _mm_sub_epi16(a, c);
+            __m128i pc = _mm_add_epi16(pa, pb);
+            pa = _mm_max_epi16(pa, _mm_sub_epi16(zero, pa));
+            pb = _mm_max_epi16(pb, _mm_sub_epi16(zero, pb));
+            pc = _mm_max_epi16(pc, _mm_sub_epi16(zero, pc));
+            __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+            __m128i isb = _mm_cmpeq_epi16(smallest, pb);
+            __m128i isa = _mm_cmpeq_epi16(smallest, pa);
+            __m128i nearest = _mm_or_si128(_mm_and_si128(isb, b), _mm_andnot_si128(isb, c));
+            nearest = _mm_or_si128(_mm_and_si128(isa, a), _mm_andnot_si128(isa, nearest));
+            a = _mm_and_si128(_mm_add_epi16(x, nearest), mask);
+            *(leanloader_i32u*)(cur + i) = _mm_cvtsi128_si32(_mm_packus_epi16(a, a));
+            c = b;
+        }
+    }
+}
+
+// every AVX2 processor has SSE4.1 too, so paeth gets abs and blendv here
+__attribute__((target("avx2")))
+static void leanloader_unfilter_avx2(u32 filter, u8* cur, u8* raw, u8* prev, u32 n, u32 bpp) {
+    if (filter == 2) {
+        for (u32 i = 0; i < n; i += 32) {
+            __m256i x = _mm256_loadu_si256((__m256i*)(raw + i));
+            __m256i b = _mm256_loadu_si256((__m256i*)(prev + i));
+            _mm256_storeu_si256((__m256i*)(cur + i), _mm256_add_epi8(x, b));
+        }
+        return;
+    }
+    if (filter != 4 || (bpp != 4 && bpp != 3)) {
+        leanloader_unfilter_sse2(filter, cur, raw, prev, n, bpp);
+        return;
+    }
+    __m128i zero = _mm_setzero_si128();
+    __m128i a = zero;
+    __m128i c = zero;
+    __m128i mask = _mm_set1_epi16(0x00ff);
+    for (u32 i = 0; i < n; i += bpp) {
+        __m128i b = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(leanloader_i32u*)(prev + i)), zero);
+        __m128i x = _mm_unpacklo_epi8(_mm_cvtsi32_si128(*(leanloader_i32u*)(raw + i)), zero);
+        __m128i pa = _mm_sub_epi16(b, c);
+        __m128i pb = _mm_sub_epi16(a, c);
+        __m128i pc = _mm_abs_epi16(_mm_add_epi16(pa, pb));
+        pa = _mm_abs_epi16(pa);
+        pb = _mm_abs_epi16(pb);
+        __m128i smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+        __m128i nearest = _mm_blendv_epi8(c, b, _mm_cmpeq_epi16(smallest, pb));
+        nearest = _mm_blendv_epi8(nearest, a, _mm_cmpeq_epi16(smallest, pa));
+        a = _mm_and_si128(_mm_add_epi16(x, nearest), mask);
+        *(leanloader_i32u*)(cur + i) = _mm_cvtsi128_si32(_mm_packus_epi16(a, a));
+        c = b;
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void leanloader_unfilter_avx512(u32 filter, u8* cur, u8* raw, u8* prev, u32 n, u32 bpp) {
+    if (filter != 2) {
+        leanloader_unfilter_avx2(filter, cur, raw, prev, n, bpp);
+        return;
+    }
+    for (u32 i = 0; i < n; i += 64) {
+        __m512i x = _mm512_loadu_si512((__m512i*)(raw + i));
+        __m512i b = _mm512_loadu_si512((__m512i*)(prev + i));
+        _mm512_storeu_si512((__m512i*)(cur + i), _mm512_add_epi8(x, b));
+    }
+}
+#else
+#define leanloader_unfilter_sse2    leanloader_unfilter_scalar
+#define leanloader_unfilter_avx2    leanloader_unfilter_scalar
+#define leanloader_unfilter_avx512  leanloader_unfilter_scalar
+#endif
+
+// indexed by LEANLOADER_CPU_*
+static leanloader_unfilter_kernel_t leanloader_unfilter_kernels[4] = {
+    leanloader_unfilter_scalar, leanloader_unfilter_sse2, leanloader_unfilter_avx2, leanloader_unfilter_avx512};
+
+// reverses the filter on one row
+static void leanloader_png_unfilter(u32 filter, u8* cur, u8* raw, u8* prev, u32 n, u32 bpp) {
+    if (filter == 0)
+        leanloader_copy(cur, raw, n);
+    else
+        leanloader_unfilter_kernels[env.cpu](filter, cur, raw, prev, n, bpp);
+}
+
+// parses the headers and sets up the decoder. returns 0 for anything that isn't a PNG, or
+// that we'd rather leave to GDI+: interlaced images, and an explicit gamma other than the
+// sRGB-ish 1/2.2 (GDI+ applies gAMA, so we'd come out different.)
+static i32 leanloader_png_open(leanloader_png* png, u8* data, u64 size) {
+    static u8 signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    if (size < 8 + 25 + 12)
+        return 0;
+    for (u32 i = 0; i < 8; i++) {
+        if (data[i] != signature[i])
+            return 0;
+    }
+    u8* ihdr = data + 8;
+    if (leanloader_get32be(ihdr) != 13 || leanloader_get32be(ihdr + 4) != 0x49484452)
+        return 0;
+    leanloader_fill(png, 0, sizeof(leanloader_png));
+    png->w     = leanloader_get32be(ihdr + 8);
+    png->h     = leanloader_get32be(ihdr + 12);
+    png->depth = ihdr[16];
+    png->color = ihdr[17];
+    // compression, filter method, interlace
+    if (ihdr[18] != 0 || ihdr[19] != 0 || ihdr[20] != 0)
+        return 0;
+    if (png->w == 0 || png->h == 0 || png->w > 0x7fffffff || png->h > 0x7fffffff)
+        return 0;
+    static u8 channels[7] = {1, 0, 3, 1, 2, 0, 4};
+    u32 d = png->depth;
+    u32 c = png->color;
+    if (c > 6 || channels[c] == 0)
+        return 0;
+    u32 lowdepth = d == 1 || d == 2 || d == 4;
+    if (!(d == 8 || (d == 16 && c != 3) || (lowdepth && (c == 0 || c == 3))))
+        return 0;
+    u32 bits = channels[c] * d;
+    png->bpp = bits < 8 ? 1 : bits / 8;
+    // rows become strides eventually, which are 32-bit
+    if (((u64)png->w * bits + 7) / 8 > 0x7fffff00)
+        return 0;
+    png->rowbytes = (u32)(((u64)png->w * bits + 7) / 8);
+    for (u32 i = 0; i < 256; i++)
+        png->palette[i] = 0xff000000;
+    // walk the chunks up to the first IDAT
+    u8* chunk = data + 8 + 25;
+    u8* end = data + size;
+    u32 haspalette = 0;
+    for (;;) {
+        if (end - chunk < 12)
+            return 0;
+        u32 len  = leanloader_get32be(chunk);
+        u32 type = leanloader_get32be(chunk + 4);
+        u8* p = chunk + 8;
+        if (len > (u64)(end - chunk) - 12)
+            return 0;
+        if (type == 0x49444154) {           // IDAT
+            break;
+        } else if (type == 0x504c5445) {    // PLTE
+            if (len % 3 || len > 768)
+                return 0;
+            for (u32 i = 0; i < len / 3; i++)
+                png->palette[i] = 0xff000000 | (u32)p[i * 3] << 16 | (u32)p[i * 3 + 1] << 8 | p[i * 3 + 2];
+            haspalette = 1;
+        } else if (type == 0x74524e53) {    // tRNS
+            if (c == 3) {
+                for (u32 i = 0; i < len && i < 256; i++)
+                    png->palette[i] = (png->palette[i] & 0x00ffffff) | (u32)p[i] << 24;
+            } else if (c == 0 && len >= 2) {
+                png->trns = 1;
+                png->key[0] = (u16)(p[0] << 8 | p[1]);
+            } else if (c == 2 && len >= 6) {
+                png->trns = 1;
+                png->key[0] = (u16)(p[0] << 8 | p[1]);
+                png->key[1] = (u16)(p[2] << 8 | p[3]);
+                png->key[2] = (u16)(p[4] << 8 | p[5]);
+            }
+        } else if (type == 0x67414d41) {    // gAMA
+            if (len < 4)
+                return 0;
+            u32 gamma = leanloader_get32be(p);
+            if (gamma < 45355 || gamma > 45555)
+                return 0;
+        } else if (type == 0x49454e44) {    // IEND
+            return 0;
+        }
+        chunk = p + len + 4;
+    }
+    if (c == 3 && !haspalette)
+        return 0;
+    png->idat = chunk;
+    png->z.next = chunk;
+    png->z.end = end;
+    png->z.type = 3;
+    if (!leanloader_znextidat(&png->z))
+        return 0;
+    // the zlib header: deflate, no preset dictionary
+    leanloader_zrefill(&png->z);
+    u32 cmf = leanloader_zget(&png->z, 8);
+    u32 flg = leanloader_zget(&png->z, 8);
+    if ((cmf & 15) != 8 || (cmf >> 4) > 7 || (cmf << 8 | flg) % 31 || (flg & 32))
+        return 0;
+    // the window holds the deflate history, up to two rows, and some room to inflate ahead
+    u32 GMEM_FIXED = 0x0000;
+    u32 GPTR = 0x0040;
+    u64 rowlen = (u64)png->rowbytes + 1;
+    u64 winsize = 32768 + 2 * rowlen + 262144 + LEANLOADER_ZSLACK + 64;
+    png->window = env.GlobalAlloc(GMEM_FIXED, winsize);
+    png->rows = env.GlobalAlloc(GPTR, 2 * ((u64)png->rowbytes + 128));
+    if (png->window == 0 || png->rows == 0) {
+        if (png->window)
+            env.GlobalFree(png->window);
+        if (png->rows)
+            env.GlobalFree(png->rows);
+        return 0;
+    }
+    png->winend = png->window + winsize - 64;
+    png->wpos = png->window;
+    png->rpos = png->window;
+    png->cur  = png->rows + 64;
+    png->prev = png->rows + 64 + png->rowbytes + 128;
+    return 1;
+}
+
+static void leanloader_png_close(leanloader_png* png) {
+    env.GlobalFree(png->window);
+    env.GlobalFree(png->rows);
+}
+
+// unfilters one raw row (filter byte first) into png->cur and returns it, or 0 on a bad filter
+static u8* leanloader_png_unfilter_row(leanloader_png* png, u8* raw) {
+    if (raw[0] > 4)
+        return 0;
+    u8* row = png->prev;
+    png->prev = png->cur;
+    png->cur = row;
+    leanloader_png_unfilter(raw[0], png->cur, raw + 1, png->prev, png->rowbytes, png->bpp);
+    png->y++;
+    return png->cur;
+}
+
+// decodes the next row, and returns it unfiltered (still in PNG sample format), or 0 on error
+static u8* leanloader_png_row(leanloader_png* png) {
+    u64 rowlen = (u64)png->rowbytes + 1;
+    while ((u64)(png->wpos - png->rpos) < rowlen) {
+        if (png->z.done)
+            return 0;
+        // not enough room left for the rest of this row: slide everything down, keeping
+        // the 32k of history deflate is allowed to reach back into
+        // (the last inflate may have overshot its target, by up to one match)
+        if (png->rpos + rowlen > png->winend - LEANLOADER_ZSLACK) {
+            u8* keep = png->wpos - png->window > 32768 ? png->wpos - 32768 : png->window;
+            if (png->rpos < keep)
+                keep = png->rpos;
+            u64 delta = (u64)(keep - png->window);
+            leanloader_copy(png->window, keep, (u64)(png->wpos - keep));
+            png->wpos -= delta;
+            png->rpos -= delta;
+        }
+        u8* out = leanloader_inflate_run(&png->z, png->wpos, png->window, png->winend - LEANLOADER_ZSLACK);
+        if (out == 0)
+            return 0;
+        png->wpos = out;
+    }
+    u8* raw = png->rpos;
+    png->rpos += rowlen;
+    return leanloader_png_unfilter_row(png, raw);
+}
+
+// 16-bit samples are rounded, not truncated, to 8 bits
+static u32 leanloader_png_sample(u8* row, u32 index, u32 depth) {
+    if (depth == 8)
+        return row[index];
+    if (depth == 16) {
+        u32 v = (u32)row[index * 2] << 8 | row[index * 2 + 1];
+        return (v * 255 + 32895) >> 16;
+    }
+    u32 bit = index * depth;
+    return (u32)(row[bit >> 3] >> (8 - depth - (bit & 7))) & ((1u << depth) - 1);
+}
+
+static u32 leanloader_png_key(u8* row, u32 index, u32 depth) {
+    if (depth == 16)
+        return (u32)row[index * 2] << 8 | row[index * 2 + 1];
+    return leanloader_png_sample(row, index, depth);
+}
+
+// the two conversions nearly every PNG goes through, 8-bit RGBA and RGB to ARGB. the vector
+// versions may read up to 16 bytes past the last pixel; the row buffers have the slack.
+typedef void (*leanloader_rgba_kernel_t)(u8* src, u32* dst, u32 n);
+
+static void leanloader_rgba_scalar(u8* src, u32* dst, u32 n) {
+    for (u32 i = 0; i < n; i++) {
+        u8* p = src + i * 4;
+        dst[i] = (u32)p[3] << 24 | (u32)p[0] << 16 | (u32)p[1] << 8 | p[2];
+    }
+}
+
+static void leanloader_rgb_scalar(u8* src, u32* dst, u32 n) {
+    for (u32 i = 0; i < n; i++) {
+        u8* p = src + i * 3;
+        dst[i] = 0xff000000 | (u32)p[0] << 16 | (u32)p[1] << 8 | p[2];
+    }
+}
+
+#if defined(__SSE2__)
+// without pshufb, RGBA is the same swap of red and blue as leanloader_swizzle_sse2, and RGB
+// is left to the scalar loop
+__attribute__((target("sse2")))
+static void leanloader_rgba_sse2(u8* src, u32* dst, u32 n) {
+    __m128i ag = _mm_set1_epi32(0xff00ff00);
+    __m128i lo = _mm_set1_epi32(0xff);
+    u32 i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m128i x = _mm_loadu_si128((__m128i*)(src + i * 4));
+        __m128i rb = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 16), lo), _mm_slli_epi32(_mm_and_si128(x, lo), 16));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(x, ag), rb));
+    }
+    leanloader_rgba_scalar(src + i * 4, dst + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static void leanloader_rgba_avx2(u8* src, u32* dst, u32 n) {
+    __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                       2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    u32 i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_loadu_si256((__m256i*)(src + i * 4));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_shuffle_epi8(x, shuffle));
+    }
+    leanloader_rgba_scalar(src + i * 4, dst + i, n - i);
+}
+
+// 8 pixels are 24 bytes: a permute splits them 12 and 12 over the two lanes, then the same
+// pshufb as the 128-bit version spreads each lane out to 4 pixels
+__attribute__((target("avx2")))
+static void leanloader_rgb_avx2(u8* src, u32* dst, u32 n) {
+    __m256i split = _mm256_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0);
+    __m256i shuffle = _mm256_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1,
+                                       2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+    __m256i alpha = _mm256_set1_epi32(0xff000000);
+    u32 i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i x = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((__m256i*)(src + i * 3)), split);
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_or_si256(_mm256_shuffle_epi8(x, shuffle), alpha));
+    }
+    leanloader_rgb_scalar(src + i * 3, dst + i, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void leanloader_rgba_avx512(u8* src, u32* dst, u32 n) {
+    __m512i shuffle = _mm512_broadcast_i32x4(_mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15));
+    u32 i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i x = _mm512_loadu_si512((__m512i*)(src + i * 4));
+        _mm512_storeu_si512((__m512i*)(dst + i), _mm512_shuffle_epi8(x, shuffle));
+    }
+    leanloader_rgba_avx2(src + i * 4, dst + i, n - i);
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void leanloader_rgb_avx512(u8* src, u32* dst, u32 n) {
+    __m512i split = _mm512_setr_epi32(0, 1, 2, 0, 3, 4, 5, 0, 6, 7, 8, 0, 9, 10, 11, 0);
+    __m512i shuffle = _mm512_broadcast_i32x4(_mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1));
+    __m512i alpha = _mm512_set1_epi32(0xff000000);
+    u32 i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m512i x = _mm512_permutexvar_epi32(split, _mm512_loadu_si512((__m512i*)(src + i * 3)));
+        _mm512_storeu_si512((__m512i*)(dst + i), _mm512_or_si512(_mm512_shuffle_epi8(x, shuffle), alpha));
+    }
+    leanloader_rgb_avx2(src + i * 3, dst + i, n - i);
+}
+#else
+#define leanloader_rgba_sse2    leanloader_rgba_scalar
+#define leanloader_rgba_avx2    leanloader_rgba_scalar
+#define leanloader_rgba_avx512  leanloader_rgba_scalar
+#define leanloader_rgb_avx2     leanloader_rgb_scalar
+#define leanloader_rgb_avx512   leanloader_rgb_scalar
+#endif
+
+// indexed by LEANLOADER_CPU_*
+static leanloader_rgba_kernel_t leanloader_rgba_kernels[4] = {
+    leanloader_rgba_scalar, leanloader_rgba_sse2, leanloader_rgba_avx2, leanloader_rgba_avx512};
+static leanloader_rgba_kernel_t leanloader_rgb_kernels[4] = {
+    leanloader_rgb_scalar, leanloader_rgb_scalar, leanloader_rgb_avx2, leanloader_rgb_avx512};
+
+// converts n pixels of an unfiltered row, starting at pixel x0, to 32bpp ARGB
+static void leanloader_png_convert(leanloader_png* png, u8* row, u32* dst, u32 x0, u32 n) {
+    u32 d = png->depth;
+    u32 i = 0;
+    if (d == 8 && png->color == 6) {
+        leanloader_rgba_kernels[env.cpu](row + (u64)x0 * 4, dst, n);
+        return;
+    }
+    if (d == 8 && png->color == 2 && !png->trns) {
+        leanloader_rgb_kernels[env.cpu](row + (u64)x0 * 3, dst, n);
+        return;
+    }
+    if (png->color == 3) {
+        for (; i < n; i++)
+            dst[i] = png->palette[leanloader_png_sample(row, x0 + i, d)];
+        return;
+    }
+    // gray expands to 8 bits by replicating, which is what multiplying by 255 / (2^d - 1) does
+    static u8 graymul[9] = {0, 255, 85, 0, 17, 0, 0, 0, 1};
+    for (; i < n; i++) {
+        u32 x = x0 + i;
+        u32 r, g, b, a = 255;
+        if (png->color == 0) {
+            r = g = b = leanloader_png_sample(row, x, d) * (d < 8 ? graymul[d] : 1);
+            if (png->trns && leanloader_png_key(row, x, d) == png->key[0])
+                a = 0;
+        } else if (png->color == 2) {
+            r = leanloader_png_sample(row, x * 3, d);
+            g = leanloader_png_sample(row, x * 3 + 1, d);
+            b = leanloader_png_sample(row, x * 3 + 2, d);
+            if (png->trns && leanloader_png_key(row, x * 3, d) == png->key[0] &&
+                leanloader_png_key(row, x * 3 + 1, d) == png->key[1] && leanloader_png_key(row, x * 3 + 2, d) == png->key[2])
+                a = 0;
+        } else if (png->color == 4) {
+            r = g = b = leanloader_png_sample(row, x * 2, d);
+            a = leanloader_png_sample(row, x * 2 + 1, d);
+        } else {
+            r = leanloader_png_sample(row, x * 4, d);
+            g = leanloader_png_sample(row, x * 4 + 1, d);
+            b = leanloader_png_sample(row, x * 4 + 2, d);
+            a = leanloader_png_sample(row, x * 4 + 3, d);
+        }
+        dst[i] = a << 24 | r << 16 | g << 8 | b;
+    }
+}
+
+// writes one unfiltered row out to the pixel buffer
+static void leanloader_png_put(leanloader_image_info* info, leanloader_png* png, u8* row, u32 y, u32* scratch, u32 format) {
+    u8* dst = (u8*)info->bd.ptr + (u64)info->bd.stride * y;
+    u32* argb = scratch ? scratch : (u32*)dst;
+    leanloader_png_convert(png, row, argb, 0, png->w);
+    leanloader_pack(argb, dst, png->w, format);
+    if (info->mips)
+        leanloader_mips_row(info, y);
+}
+
+// the parallel PNG path, for LEANLOADER_PARALLEL. a zlib stream is one long chain where
+// every match may reach 32k back, except where the encoder did a full flush: an empty
+// stored block (00 00 ff ff), after which nothing refers back past it. encoders that
+// compress on several threads write those between their pieces, so each piece can be
+// inflated on a thread of its own. the bytes alone can't tell a real flush point from
+// 00 00 ff ff inside other data, so the pieces past the first are speculation, kept honest
+// on two counts: a piece that reaches back past its own start fails, and the piece before
+// it has to end exactly where it starts, between two blocks. anything off and we go back to
+// the plain decoder with nothing lost but time. either way the inflating runs on other
+// threads, a block at a time, while this one unfilters and converts the rows behind it.
+#define LEANLOADER_ZBLOCK       (1 << 20)   // inflated bytes per block handed to the rows
+#define LEANLOADER_PAR_MIN      (4 << 20)   // smallest inflated image worth the threads
+#define LEANLOADER_PAR_SEGMENTS 64
+#define LEANLOADER_PAR_THREADS  16
+#define LEANLOADER_PAR_AHEAD    4           // blocks the segment the rows are on may have waiting
+
+typedef struct leanloader_zblock {
+    struct leanloader_zblock* next;
+    u8* data;           // the inflated bytes, behind the history carried over from the last block
+    u64 size;
+    u64 history;
+} leanloader_zblock;
+
+typedef struct {
+    leanloader_inflate z;       // set up where the segment starts, then owned by its thread
+    leanloader_zblock* head;    // blocks inflated and not yet taken by the rows
+    leanloader_zblock* tail;
+    u32 queued;                 // how many blocks that is
+    u32 done;                   // inflated to the end, and the end checked out
+} leanloader_zsegment;
+
+typedef struct {
+    leanloader_zsegment* segs;
+    u32 count;
+    u32 next;           // the next segment a thread takes
+    u32 current;        // the one the rows are coming out of
+    u32 blocks;         // blocks allocated and not yet freed
+    u32 maxblocks;
+    u32 failed;         // set to stop everything, by either side
+    ptr lock;           // SRWLOCK, over all of the above
+    ptr cond;           // CONDITION_VARIABLE, for any change to it
+} leanloader_zparallel;
+
+// a block starting with the history from prev, the last 32k of what's been inflated
+static leanloader_zblock* leanloader_zblock_new(leanloader_zblock* prev) {
+    u32 GMEM_FIXED = 0x0000;
+    leanloader_zblock* b = env.GlobalAlloc(GMEM_FIXED, sizeof(leanloader_zblock) + 32768 + LEANLOADER_ZBLOCK + LEANLOADER_ZSLACK + 64);
+    if (b == 0)
+        return 0;
+    b->next = 0;
+    b->data = (u8*)(b + 1) + 32768;
+    b->size = 0;
+    b->history = 0;
+    if (prev) {
+        u64 n = prev->history + prev->size;
+        if (n > 32768)
+            n = 32768;
+        leanloader_copy(b->data - n, prev->data + prev->size - n, n);
+        b->history = n;
+    }
+    return b;
+}
+
+static void leanloader_zblock_publish(leanloader_zsegment* seg, leanloader_zblock* b) {
+    if (seg->tail)
+        seg->tail->next = b;
+    else
+        seg->head = b;
+    seg->tail = b;
+    seg->queued++;
+}
+
+static u32 leanloader_zworker(ptr param) {
+    leanloader_zparallel* par = param;
+    u32 INFINITE = 0xffffffff;
+    env.AcquireSRWLockExclusive(&par->lock);
+    while (!par->failed && par->next < par->count) {
+        u32 i = par->next++;
+        leanloader_zsegment* seg = &par->segs[i];
+        leanloader_zblock* b = 0;
+        i32 ok = 0;
+        for (;;) {
+            // the segment the rows are on doesn't wait for the others' blocks, which can't go
+            // before it's done, only for the rows to take some of its own; so something always
+            // moves, and one long segment is still held to a few blocks ahead
+            while (!par->failed && (i == par->current ? seg->queued >= LEANLOADER_PAR_AHEAD : par->blocks >= par->maxblocks))
+                env.SleepConditionVariableSRW(&par->cond, &par->lock, INFINITE, 0);
+            if (par->failed)
+                break;
+            par->blocks++;
+            env.ReleaseSRWLockExclusive(&par->lock);
+            // the last block can only go to the rows once its history is copied out
+            leanloader_zblock* next = leanloader_zblock_new(b);
+            env.AcquireSRWLockExclusive(&par->lock);
+            if (b) {
+                leanloader_zblock_publish(seg, b);
+                env.WakeAllConditionVariable(&par->cond);
+            }
+            b = next;
+            if (b == 0) {
+                par->blocks--;
+                break;
+            }
+            env.ReleaseSRWLockExclusive(&par->lock);
+            u8* out = leanloader_inflate_run(&seg->z, b->data, b->data - b->history, b->data + LEANLOADER_ZBLOCK);
+            env.AcquireSRWLockExclusive(&par->lock);
+            if (out == 0)
+                break;
+            b->size = (u64)(out - b->data);
+            if (seg->z.done) {
+                // the last segment has to end the stream, the others have to stop short of that
+                ok = (i + 1 == par->count) == (seg->z.final != 0);
+                if (ok) {
+                    leanloader_zblock_publish(seg, b);
+                    b = 0;
+                }
+                break;
+            }
+        }
+        if (b) {
+            env.GlobalFree(b);
+            par->blocks--;
+        }
+        if (ok)
+            seg->done = 1;
+        else
+            par->failed = 1;
+        env.WakeAllConditionVariable(&par->cond);
+    }
+    env.ReleaseSRWLockExclusive(&par->lock);
+    return 0;
+}
+
+// frees the block the rows are done with and hands them the next one, 0 when there are
+// no more or something failed
+static leanloader_zblock* leanloader_zparallel_next(leanloader_zparallel* par, leanloader_zblock* done) {
+    u32 INFINITE = 0xffffffff;
+    leanloader_zblock* b = 0;
+    if (done)
+        env.GlobalFree(done);
+    env.AcquireSRWLockExclusive(&par->lock);
+    if (done)
+        par->blocks--;
+    while (!par->failed) {
+        leanloader_zsegment* seg = &par->segs[par->current];
+        if (seg->head) {
+            b = seg->head;
+            seg->head = b->next;
+            if (seg->head == 0)
+                seg->tail = 0;
+            seg->queued--;
+            break;
+        }
+        if (seg->done) {
+            if (par->current + 1 == par->count)
+                break;
+            par->current++;
+            continue;
+        }
+        env.SleepConditionVariableSRW(&par->cond, &par->lock, INFINITE, 0);
+    }
+    env.WakeAllConditionVariable(&par->cond);
+    env.ReleaseSRWLockExclusive(&par->lock);
+    return b;
+}
+
+// splits the IDAT data into segments at likely full flush points, at least spacing bytes
+// apart. the first segment carries on from png->z, the others start from scratch.
+static u32 leanloader_zsegments(leanloader_png* png, leanloader_zsegment* segs, u32 max, u64 spacing) {
+    leanloader_fill(segs, 0, (u64)max * sizeof(leanloader_zsegment));
+    segs[0].z = png->z;
+    u32 count = 1;
+    u64 offset = 0;     // IDAT bytes before this chunk
+    u64 last = 0;       // where the last segment starts
+    u32 tail = 1;       // the last four bytes seen
+    u8* end = png->z.end;
+    u8* chunk = png->idat;
+    while (count < max && chunk + 12 <= end && leanloader_get32be(chunk + 4) == 0x49444154) {
+        u32 len = leanloader_get32be(chunk);
+        if (len > (u64)(end - chunk) - 12)
+            break;
+        u8* p = chunk + 8;
+        // nothing ending before last + spacing can start a segment, so don't look there
+        u64 skip = last + spacing - 4;
+        u32 j = 0;
+        if (skip > offset) {
+            j = skip - offset < len ? (u32)(skip - offset) : len;
+            tail = 1;
+        }
+        for (; j < len && count < max; j++) {
+            tail = tail << 8 | p[j];
+            if (tail == 0x0000ffff && offset + j + 1 - last >= spacing) {
+                last = offset + j + 1;
+                leanloader_inflate* z = &segs[count].z;
+                z->in = p + j + 1;
+                z->inend = p + len;
+                z->next = p + len + 4;
+                z->end = end;
+                z->type = 3;
+                z->consumed = last;
+                segs[count - 1].z.stop = last;
+                count++;
+            }
+        }
+        offset += len;
+        chunk = p + len + 4;
+    }
+    return count;
+}
+
+// decodes the rows with the inflating done on other threads. returns 0 without having
+// touched png->z if it can't, so the caller can go on with the plain decoder.
+static i32 leanloader_png_parallel(leanloader_image_info* info, leanloader_png* png, u32* scratch, u32 format) {
+    u32 GMEM_FIXED = 0x0000;
+    u32 INFINITE = 0xffffffff;
+    u64 rowlen = (u64)png->rowbytes + 1;
+    u32 threads = env.GetActiveProcessorCount(0xffff) - 1;     // ALL_PROCESSOR_GROUPS
+    if (rowlen * png->h < LEANLOADER_PAR_MIN || threads == 0 || threads > 1024 || env.SleepConditionVariableSRW == 0)
+        return 0;
+    if (threads > LEANLOADER_PAR_THREADS)
+        threads = LEANLOADER_PAR_THREADS;
+    u64 compressed = 0;
+    for (u8* chunk = png->idat; chunk + 12 <= png->z.end && leanloader_get32be(chunk + 4) == 0x49444154;) {
+        u32 len = leanloader_get32be(chunk);
+        if (len > (u64)(png->z.end - chunk) - 12)
+            break;
+        compressed += len;
+        chunk += 12 + (u64)len;
+    }
+    leanloader_zsegment* segs = env.GlobalAlloc(GMEM_FIXED, LEANLOADER_PAR_SEGMENTS * sizeof(leanloader_zsegment));
+    u8* straddle = env.GlobalAlloc(GMEM_FIXED, rowlen + 64);
+    if (segs == 0 || straddle == 0) {
+        if (segs)
+            env.GlobalFree(segs);
+        if (straddle)
+            env.GlobalFree(straddle);
+        return 0;
+    }
+    // a few segments per thread, so one slow one doesn't hold the rest up
+    u64 spacing = compressed / (threads * 4);
+    if (spacing < 65536)
+        spacing = 65536;
+    leanloader_zparallel par = {segs, 0, 0, 0, 0, 2 * threads + 4, 0, 0, 0};
+    par.count = leanloader_zsegments(png, segs, LEANLOADER_PAR_SEGMENTS, spacing);
+    if (threads > par.count)
+        threads = par.count;
+    ptr handles[LEANLOADER_PAR_THREADS];
+    u32 started = 0;
+    for (u32 i = 0; i < threads; i++) {
+        handles[started] = env.CreateThread(0, 0, leanloader_zworker, &par, 0, 0);
+        if (handles[started])
+            started++;
+    }
+    u32 y = 0;
+    if (started) {
+        // rows that straddle two blocks get put together in straddle first
+        leanloader_zblock* b = leanloader_zparallel_next(&par, 0);
+        u64 pos = 0;
+        for (; y < png->h && b; y++) {
+            while (b && pos == b->size) {
+                b = leanloader_zparallel_next(&par, b);
+                pos = 0;
+            }
+            u8* raw;
+            if (b && b->size - pos >= rowlen) {
+                raw = b->data + pos;
+                pos += rowlen;
+            } else {
+                u64 got = 0;
+                while (b && got < rowlen) {
+                    u64 n = b->size - pos < rowlen - got ? b->size - pos : rowlen - got;
+                    leanloader_copy(straddle + got, b->data + pos, n);
+                    got += n;
+                    pos += n;
+                    if (pos == b->size) {
+                        b = leanloader_zparallel_next(&par, b);
+                        pos = 0;
+                    }
+                }
+                if (got < rowlen)
+                    break;
+                raw = straddle;
+            }
+            u8* row = leanloader_png_unfilter_row(png, raw);
+            if (row == 0)
+                break;
+            leanloader_png_put(info, png, row, y, scratch, format);
+        }
+        if (b)
+            env.GlobalFree(b);
+        // done one way or another, so the threads can stop
+        env.AcquireSRWLockExclusive(&par.lock);
+        par.failed = 1;
+        env.WakeAllConditionVariable(&par.cond);
+        env.ReleaseSRWLockExclusive(&par.lock);
+        for (u32 i = 0; i < started; i++) {
+            env.WaitForSingleObject(handles[i], INFINITE);
+            env.CloseHandle(handles[i]);
+        }
+    }
+    for (u32 i = 0; i < par.count; i++) {
+        for (leanloader_zblock* b = segs[i].head; b;) {
+            leanloader_zblock* next = b->next;
+            env.GlobalFree(b);
+            b = next;
+        }
+    }
+    env.GlobalFree(segs);
+    env.GlobalFree(straddle);
+    if (y == png->h)
+        return 1;
+    // start the plain decoder over from a clean slate; the rows written so far get redone
+    leanloader_fill(png->rows, 0, 2 * ((u64)png->rowbytes + 128));
+    png->y = 0;
+    return 0;
+}
+
+// decodes a whole PNG into a fresh pixel buffer. returns 0 if we couldn't, in which case
+// GDI+ gets a shot at it.
+static i32 leanloader_png_decode(leanloader_image_info* info, u8* data, u64 size) {
+    leanloader_png png;
+    if (!leanloader_png_open(&png, data, size))
+        return 0;
+    u32 format = leanloader_format(info);
+    u32* scratch;
+    i32 decoded = 0;
+    if (leanloader_scratch_alloc(format, png.w, info->dst != 0, &scratch) && leanloader_alloc_pixels(info, png.w, png.h)) {
+        u32 y = 0;
+        if ((info->flags & LEANLOADER_PARALLEL) && leanloader_png_parallel(info, &png, scratch, format))
+            y = png.h;
+        for (; y < png.h; y++) {
+            u8* row = leanloader_png_row(&png);
+            if (row == 0)
+                break;
+            leanloader_png_put(info, &png, row, y, scratch, format);
+        }
+        if (y == png.h) {
+            info->bd.w = png.w;
+            info->bd.h = png.h;
+            decoded = 1;
+        } else {
+            // the zlib stream is broken or cut short, which GDI+ wouldn't get past either
+            leanloader_free_pixels(info);
+            info->error = LEANLOADER_ERROR_CORRUPT;
+        }
+    }
+    if (scratch)
+        env.GlobalFree(scratch);
+    leanloader_png_close(&png);
+    return decoded;
+}
+
+// reads the dimensions and pixel format (as a GDI+ PixelFormat value, describing the file
+// rather than what leanloader_load would hand out) from the first bytes of a BMP or PNG.
+// for PNGs that's IHDR alone, so a tRNS chunk further on doesn't show up as alpha.
+static i32 leanloader_probe_header(u8* data, u64 size, u32* w, u32* h, u32* format) {
+    u32 PixelFormat1bppIndexed  = 0x00030101;
+    u32 PixelFormat4bppIndexed  = 0x00030402;
+    u32 PixelFormat8bppIndexed  = 0x00030803;
+    u32 PixelFormat16bppRGB555  = 0x00021005;
+    u32 PixelFormat24bppRGB     = 0x00021808;
+    u32 PixelFormat32bppRGB     = 0x00022009;
+    u32 PixelFormat32bppARGB    = 0x0026200a;
+    u32 PixelFormat48bppRGB     = 0x0010300c;
+    u32 PixelFormat64bppARGB    = 0x0034400d;
+    if (size >= 26 && data[0] == 'B' && data[1] == 'M') {
+        u32 hdrsize = leanloader_get32(data + 14);
+        i32 bw, bh;
+        u32 bpp;
+        if (hdrsize == 12) {
+            bw  = leanloader_get16(data + 18);
+            bh  = leanloader_get16(data + 20);
+            bpp = leanloader_get16(data + 24);
+        } else if (hdrsize >= 40 && size >= 54) {
+            bw  = (i32)leanloader_get32(data + 18);
+            bh  = (i32)leanloader_get32(data + 22);
+            bpp = leanloader_get16(data + 28);
+        } else {
+            return 0;
+        }
+        if (bh < 0)
+            bh = -bh;
+        if (bw <= 0 || bh <= 0)
+            return 0;
+        *w = (u32)bw;
+        *h = (u32)bh;
+        // same rule as the decoder: 32bpp only has alpha if a mask says so
+        u32 alphamask = 0;
+        u32 compression = hdrsize >= 40 ? leanloader_get32(data + 30) : 0;
+        if (bpp == 32 && compression != 0 && (hdrsize >= 56 || compression == 6) && size >= 70)
+            alphamask = leanloader_get32(data + 66);
+        *format = bpp == 1  ? PixelFormat1bppIndexed :
+                  bpp == 4  ? PixelFormat4bppIndexed :
+                  bpp == 8  ? PixelFormat8bppIndexed :
+                  bpp == 16 ? PixelFormat16bppRGB555 :
+                  bpp == 24 ? PixelFormat24bppRGB :
+                  alphamask ? PixelFormat32bppARGB : PixelFormat32bppRGB;
+        return 1;
+    }
+    static u8 signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+    if (size < 8 + 25)
+        return 0;
+    for (u32 i = 0; i < 8; i++) {
+        if (data[i] != signature[i])
+            return 0;
+    }
+    u8* ihdr = data + 8;
+    if (leanloader_get32be(ihdr) != 13 || leanloader_get32be(ihdr + 4) != 0x49484452)
+        return 0;
+    *w = leanloader_get32be(ihdr + 8);
+    *h = leanloader_get32be(ihdr + 12);
+    if (*w == 0 || *h == 0)
+        return 0;
+    u32 depth = ihdr[16];
+    u32 color = ihdr[17];
+    if (color == 0 || color == 3)
+        *format = depth == 1 ? PixelFormat1bppIndexed : depth <= 4 ? PixelFormat4bppIndexed :
+                  depth == 8 ? PixelFormat8bppIndexed : PixelFormat48bppRGB;
+    else if (color == 2)
+        *format = depth == 16 ? PixelFormat48bppRGB : PixelFormat24bppRGB;
+    else
+        *format = depth == 16 ? PixelFormat64bppARGB : PixelFormat32bppARGB;
+    return 1;
+}
+
+// a quick look at the first bytes of a file, so that GDI+ never sees anything it would
+// only fail on, slowly: BMPs and PNGs have to have sane headers (PNGs complete chunks and
+// some image data) and fit maxpixels, as do GIFs and JPEGs, and anything else has to at
+// least have the signature of a format GDI+ reads. returns a LEANLOADER_ERROR_*, 0 if
+// the load should go on.
+static u32 leanloader_sniff(u8* data, u64 size, u64 maxpixels) {
+    u32 w = 0, h = 0, format;
+    if (size >= 2 && data[0] == 'B' && data[1] == 'M') {
+        if (!leanloader_probe_header(data, size, &w, &h, &format))
+            return LEANLOADER_ERROR_CORRUPT;
+        // uncompressed pixels have to be all there; RLE and the like are GDI+'s business
+        u32 hdrsize = leanloader_get32(data + 14);
+        u32 compression = hdrsize >= 40 ? leanloader_get32(data + 30) : 0;
+        u32 bpp = leanloader_get16(data + (hdrsize == 12 ? 24 : 28));
+        if (compression == 0 || compression == 3 || compression == 6) {
+            u64 rowbytes = ((u64)w * bpp + 31) / 32 * 4;
+            if ((u64)leanloader_get32(data + 10) + rowbytes * h > size)
+                return LEANLOADER_ERROR_CORRUPT;
+        }
+    } else if (size >= 8 && leanloader_get32be(data) == 0x89504e47 && leanloader_get32be(data + 4) == 0x0d0a1a0a) {
+        if (!leanloader_probe_header(data, size, &w, &h, &format) || w > 0x7fffffff || h > 0x7fffffff)
+            return LEANLOADER_ERROR_CORRUPT;
+        u8* ihdr = data + 8;
+        u32 d = ihdr[16], c = ihdr[17];
+        u32 depthok = c == 0 ? d == 1 || d == 2 || d == 4 || d == 8 || d == 16 :
+                      c == 3 ? d == 1 || d == 2 || d == 4 || d == 8 :
+                      c == 2 || c == 4 || c == 6 ? d == 8 || d == 16 : 0;
+        if (!depthok || ihdr[18] != 0 || ihdr[19] != 0 || ihdr[20] > 1)
+            return LEANLOADER_ERROR_CORRUPT;
+        // every chunk has to fit, and there has to be an IDAT before IEND (or the end)
+        u8* chunk = data + 8;
+        u8* end = data + size;
+        u32 idat = 0;
+        while (end - chunk >= 12) {
+            u32 len = leanloader_get32be(chunk);
+            u32 type = leanloader_get32be(chunk + 4);
+            if (len > (u64)(end - chunk) - 12)
+                return LEANLOADER_ERROR_CORRUPT;
+            if (type == 0x49454e44)         // IEND
+                break;
+            idat |= type == 0x49444154;
+            chunk += (u64)len + 12;
+        }
+        if (!idat)
+            return LEANLOADER_ERROR_CORRUPT;
+    } else if (size >= 10 && data[0] == 'G' && data[1] == 'I' && data[2] == 'F' && data[3] == '8') {
+        // the logical screen, which every frame fits in
+        w = leanloader_get16(data + 6);
+        h = leanloader_get16(data + 8);
+    } else if (size >= 4 && data[0] == 0xff && data[1] == 0xd8 && data[2] == 0xff) {
+        // the first frame header, skipping the segments in front of it
+        u64 i = 2;
+        for (;;) {
+            if (i + 4 > size || data[i] != 0xff)
+                return LEANLOADER_ERROR_CORRUPT;
+            while (i + 4 < size && data[i + 1] == 0xff)
+                i++;
+            u32 marker = data[i + 1];
+            // image data, or the end of it, before any frame header
+            if (marker == 0xd9 || marker == 0xda)
+                return LEANLOADER_ERROR_CORRUPT;
+            if (marker == 0x01 || (marker >= 0xd0 && marker <= 0xd7)) {
+                i += 2;
+                continue;
+            }
+            u32 len = (u32)data[i + 2] << 8 | data[i + 3];
+            if (len < 2)
+                return LEANLOADER_ERROR_CORRUPT;
+            // SOF0..15, which DHT, JPG and DAC share the range with
+            if (marker >= 0xc0 && marker <= 0xcf && marker != 0xc4 && marker != 0xc8 && marker != 0xcc) {
+                if (len < 8 || i + 9 > size)
+                    return LEANLOADER_ERROR_CORRUPT;
+                h = (u32)data[i + 5] << 8 | data[i + 6];
+                w = (u32)data[i + 7] << 8 | data[i + 8];
+                if (w == 0)
+                    return LEANLOADER_ERROR_CORRUPT;
+                break;
+            }
+            i += 2 + (u64)len;
+        }
+    } else if (size >= 4 && (leanloader_get32(data) == 0x002a4949 || leanloader_get32(data) == 0x2a004d4d)) {
+        // TIFF, either byte order
+    } else if (size >= 6 && leanloader_get16(data) == 0 && (leanloader_get16(data + 2) == 1 || leanloader_get16(data + 2) == 2) &&
+               leanloader_get16(data + 4) != 0) {
+        // ICO and CUR
+    } else if (size >= 44 && leanloader_get32(data) == 1 && leanloader_get32(data + 40) == 0x464d4520) {
+        // EMF
+    } else if (size >= 4 && (leanloader_get32(data) == 0x9ac6cdd7 || leanloader_get32(data) == 0x00090001 ||
+                             leanloader_get32(data) == 0x00090002)) {
+        // WMF, placeable or not
+    } else {
+        return LEANLOADER_ERROR_FORMAT;
+    }
+    if (maxpixels && (u64)w * h > maxpixels)
+        return LEANLOADER_ERROR_TOO_BIG;
+    return 0;
+}
+
+// the formats we decode ourselves; 0 means it's GDI+'s problem, unless info->error says
+// it would be no use trying GDI+ either
+static i32 leanloader_native_decode(leanloader_image_info* info, u8* data, u64 size, u8* view) {
+    if (!leanloader_format_native(leanloader_format(info)))
+        return 0;
+    return leanloader_bmp_decode(info, data, size, view) || leanloader_png_decode(info, data, size);
+}
+
+// clears the fields leanloader_load fills in, so a failed load is safe to dispose
+static void leanloader_reset(leanloader_image_info* info) {
+    info->gpbitmap  = 0;
+    info->bd.ptr    = 0;
+    info->mips      = 0;
+    info->frames    = 0;
+    info->error     = 0;
+    info->storage   = LEANLOADER_STORAGE_GLOBAL;
+    info->view      = 0;
+    info->cache     = 0;
+    info->allocsize = 0;
+    info->envref    = 0;
+}
+
+// converts the w x h region at x, y of a GDI+ bitmap into dst, without keeping it locked.
+// gray isn't something GDI+ locks into, so that goes through ARGB a band of rows at a time.
+static i32 leanloader_gdip_read(ptr bitmap, u32 x, u32 y, u32 w, u32 h, u8* dst, i32 stride, u32 format) {
+    u32 ImageLockModeRead           = 0x0001;
+    u32 ImageLockModeUserInputBuf   = 0x0004;
+    u32 flags = ImageLockModeRead | ImageLockModeUserInputBuf;
+    if (format != LEANLOADER_FORMAT_GRAY8) {
+        BitmapData bd = {w, h, stride, format, dst, 0};
+        Rect rect = {(i32)x, (i32)y, (i32)w, (i32)h};
+        if (env.GdipBitmapLockBits(bitmap, &rect, flags, format, &bd) != 0)
+            return 0;
+        env.GdipBitmapUnlockBits(bitmap, &bd);
+        return 1;
+    }
+    u32 GMEM_FIXED = 0x0000;
+    u32 bandrows = 16;
+    u8* band = env.GlobalAlloc(GMEM_FIXED, (u64)w * 4 * bandrows);
+    if (band == 0)
+        return 0;
+    for (u32 y0 = 0; y0 < h; y0 += bandrows) {
+        u32 rows = h - y0 < bandrows ? h - y0 : bandrows;
+        BitmapData bd = {w, rows, (i32)(w * 4), LEANLOADER_FORMAT_ARGB, band, 0};
+        Rect rect = {(i32)x, (i32)(y + y0), (i32)w, (i32)rows};
+        if (env.GdipBitmapLockBits(bitmap, &rect, flags, LEANLOADER_FORMAT_ARGB, &bd) != 0) {
+            env.GlobalFree(band);
+            return 0;
+        }
+        env.GdipBitmapUnlockBits(bitmap, &bd);
+        for (u32 r = 0; r < rows; r++)
+            leanloader_pack((u32*)(band + (u64)w * 4 * r), dst + (u64)stride * (y0 + r), w, format);
+    }
+    env.GlobalFree(band);
+    return 1;
+}
+
+// the LEANLOADER_ERROR_* closest to a GDI+ Status
+static u32 leanloader_gdip_error(u32 status) {
+    u32 InvalidParameter    = 2;
+    u32 OutOfMemory         = 3;
+    u32 FileNotFound        = 10;
+    u32 UnknownImageFormat  = 13;
+    return status == InvalidParameter   ? LEANLOADER_ERROR_CORRUPT :
+           status == OutOfMemory        ? LEANLOADER_ERROR_MEMORY :
+           status == FileNotFound       ? LEANLOADER_ERROR_OPEN :
+           status == UnknownImageFormat ? LEANLOADER_ERROR_FORMAT : LEANLOADER_ERROR_GDIPLUS;
+}
+
+// an internal function that pulls the pixels out of info->gpbitmap into our own buffer.
+// on failure the bitmap is disposed of, info->gpbitmap is cleared and info->error set.
+static i32 leanloader_decode(leanloader_image_info* info) {
+    u32 status = env.GdipGetImageWidth(info->gpbitmap, &info->bd.w);
+    LEANLOADER_COUNT(gdipfailures, status != 0);
+    if (status == 0) {
+        status = env.GdipGetImageHeight(info->gpbitmap, &info->bd.h);
+        if (status == 0 && info->maxpixels && (u64)info->bd.w * info->bd.h > info->maxpixels) {
+            info->error = LEANLOADER_ERROR_TOO_BIG;
+        } else if (status == 0) {
+            if (leanloader_alloc_pixels(info, info->bd.w, info->bd.h)) {
+                u32 ImageLockModeRead           = 0x0001;
+                u32 ImageLockModeWrite          = 0x0002;
+                u32 ImageLockModeUserInputBuf   = 0x0004;
+                u32 format = info->bd.PixelFormat;
+                u32 flags = ImageLockModeRead | ImageLockModeWrite | ImageLockModeUserInputBuf;
+                // there's no gray surface to keep locked, so gray images are always detached
+                if (format == LEANLOADER_FORMAT_GRAY8) {
+                    if (leanloader_gdip_read(info->gpbitmap, 0, 0, info->bd.w, info->bd.h, info->bd.ptr, info->bd.stride, format)) {
+                        env.GdipDisposeImage(info->gpbitmap);
+                        info->gpbitmap = 0;
+                        return 1;
+                    }
+                    leanloader_free_pixels(info);
+                    env.GdipDisposeImage(info->gpbitmap);
+                    info->gpbitmap = 0;
+                    info->error = LEANLOADER_ERROR_GDIPLUS;
+                    return 0;
+                }
+                // when detaching, a read-only lock keeps GdipBitmapUnlockBits from copying
+                // our buffer back into the GDI+ surface we're about to throw away anyway
+                if (info->flags & LEANLOADER_DETACHED)
+                    flags = ImageLockModeRead | ImageLockModeUserInputBuf;
+                Rect rect = {0, 0, info->bd.w, info->bd.h};
+                status = env.GdipBitmapLockBits(info->gpbitmap, &rect, flags, format, &info->bd);
+                LEANLOADER_COUNT(gdipfailures, status != 0);
+                if (status == 0) {
+                    leanloader_mips_build(info);
+                    if (info->flags & LEANLOADER_DETACHED) {
+                        env.GdipBitmapUnlockBits(info->gpbitmap, &info->bd);
+                        env.GdipDisposeImage(info->gpbitmap);
+                        info->gpbitmap = 0;
+                    }
+                    return 1;
+                } else {
+                    leanloader_free_pixels(info);
+                }
+            }
+        }
+    }
+    if (status != 0)
+        info->error = leanloader_gdip_error(status);
+    env.GdipDisposeImage(info->gpbitmap);
+    info->gpbitmap = 0;
+    return 0;
+}
+
+// regions and tiles read from a "source": a mapped BMP or PNG, or failing that, a GDI+ bitmap.
+// only the requested rectangles are converted. PNG rows come out of the decoder in order,
+// so a ring of the last few unfiltered rows is kept for regions that share them.
+#define LEANLOADER_SOURCE_BMP   1
+#define LEANLOADER_SOURCE_PNG   2
+#define LEANLOADER_SOURCE_GDIP  3
+
+typedef struct {
+    u32 kind;           // LEANLOADER_SOURCE_*
+    u32 w;
+    u32 h;
+    u8* view;           // the read-only mapping of the file, for the native kinds
+    leanloader_bmp bmp;
+    leanloader_png png;
+    u8* band;           // the ring of unfiltered PNG rows
+    u32 bandrows;
+    u32 bandpitch;
+    ptr gpbitmap;
+    u32 format;         // output format
+    u32* scratch;       // an ARGB row, for native kinds with narrower output formats
+} leanloader_source;
+
+// opens the image named in info. bandrows is how many rows back a PNG source has to be able
+// to go: regions are read top to bottom, and each one may start up to bandrows - 1 rows
+// above the last row of the previous one.
+static i32 leanloader_source_open(leanloader_source* src, leanloader_image_info* info, u32 bandrows) {
+    leanloader_fill(src, 0, sizeof(leanloader_source));
+    leanloader_kernel_init();
+    src->format = leanloader_format(info);
+    if (leanloader_format_bytes(src->format) == 0) {
+        info->error = LEANLOADER_ERROR_UNSUPPORTED;
+        return 0;
+    }
+    // mapped even when GDI+ reads it, so it can be sniffed first
+    u64 size = 0;
+    src->view = leanloader_map(info->name, &size, 0);
+    if (src->view == 0) {
+        info->error = LEANLOADER_ERROR_OPEN;
+        return 0;
+    }
+    info->error = leanloader_sniff(src->view, size, info->maxpixels);
+    if (!info->error && !(info->flags & LEANLOADER_NO_NATIVE) && leanloader_format_native(src->format)) {
+        if (leanloader_bmp_open(&src->bmp, src->view, size)) {
+            if (leanloader_scratch_alloc(src->format, src->bmp.w, info->dst != 0, &src->scratch)) {
+                src->kind = LEANLOADER_SOURCE_BMP;
+                src->w = src->bmp.w;
+                src->h = src->bmp.h;
+                return 1;
+            }
+        } else if (leanloader_png_open(&src->png, src->view, size)) {
+            u32 GMEM_FIXED = 0x0000;
+            if (bandrows > src->png.h)
+                bandrows = src->png.h;
+            // the conversions may read a little past the end of a row
+            u64 pitch = (u64)src->png.rowbytes + 64 + 63 & ~(u64)63;
+            src->band = env.GlobalAlloc(GMEM_FIXED, pitch * bandrows);
+            if (src->band && leanloader_scratch_alloc(src->format, src->png.w, info->dst != 0, &src->scratch)) {
+                src->kind = LEANLOADER_SOURCE_PNG;
+                src->w = src->png.w;
+                src->h = src->png.h;
+                src->bandrows = bandrows;
+                src->bandpitch = (u32)pitch;
+                return 1;
+            }
+            if (src->band)
+                env.GlobalFree(src->band);
+            src->band = 0;
+            leanloader_png_close(&src->png);
+        }
+    }
+    env.UnmapViewOfFile(src->view);
+    src->view = 0;
+    if (info->error)
+        return 0;
+    if (!leanloader_env_init()) {
+        info->error = LEANLOADER_ERROR_GDIPLUS;
+        return 0;
+    }
+    u32 status = env.GdipCreateBitmapFromFile(info->name, &src->gpbitmap);
+    if (status == 0) {
+        status = env.GdipGetImageWidth(src->gpbitmap, &src->w);
+        if (status == 0)
+            status = env.GdipGetImageHeight(src->gpbitmap, &src->h);
+        if (status == 0 && info->maxpixels && (u64)src->w * src->h > info->maxpixels) {
+            info->error = LEANLOADER_ERROR_TOO_BIG;
+        } else if (status == 0) {
+            src->kind = LEANLOADER_SOURCE_GDIP;
+            return 1;
+        }
+        env.GdipDisposeImage(src->gpbitmap);
+        src->gpbitmap = 0;
+    }
+    if (status)
+        info->error = leanloader_gdip_error(status);
+    leanloader_env_deinit();
+    return 0;
+}
+
+// what to put in info->error when leanloader_source_read fails
+static u32 leanloader_source_error(leanloader_source* src) {
+    return src->kind == LEANLOADER_SOURCE_GDIP ? LEANLOADER_ERROR_GDIPLUS : LEANLOADER_ERROR_CORRUPT;
+}
+
+// converts the w x h region at x, y (which has to be inside the image) to the output format in dst
+static i32 leanloader_source_read(leanloader_source* src, u32 x, u32 y, u32 w, u32 h, u8* dst, i32 stride) {
+    if (src->kind == LEANLOADER_SOURCE_BMP) {
+        for (u32 r = 0; r < h; r++) {
+            u8* out = dst + (u64)stride * r;
+            u32* argb = src->scratch ? src->scratch : (u32*)out;
+            leanloader_bmp_copy(&src->bmp, y + r, x, w, argb);
+            leanloader_pack(argb, out, w, src->format);
+        }
+        return 1;
+    }
+    if (src->kind == LEANLOADER_SOURCE_PNG) {
+        leanloader_png* png = &src->png;
+        for (u32 r = 0; r < h; r++) {
+            u32 row = y + r;
+            // already gone from the ring
+            if (row + src->bandrows < png->y)
+                return 0;
+            while (png->y <= row) {
+                u8* raw = leanloader_png_row(png);
+                if (raw == 0)
+                    return 0;
+                // rows too far above this one can't be asked for again
+                u32 decoded = png->y - 1;
+                if (decoded + src->bandrows > row)
+                    leanloader_copy(src->band + (u64)src->bandpitch * (decoded % src->bandrows), raw, png->rowbytes);
+            }
+            u8* raw = src->band + (u64)src->bandpitch * (row % src->bandrows);
+            u8* out = dst + (u64)stride * r;
+            u32* argb = src->scratch ? src->scratch : (u32*)out;
+            leanloader_png_convert(png, raw, argb, x, w);
+            leanloader_pack(argb, out, w, src->format);
+        }
+        return 1;
+    }
+    // GDI+ converts just the locked rectangle
+    return leanloader_gdip_read(src->gpbitmap, x, y, w, h, dst, stride, src->format);
+}
+
+static void leanloader_source_close(leanloader_source* src) {
+    if (src->kind == LEANLOADER_SOURCE_PNG) {
+        leanloader_png_close(&src->png);
+        env.GlobalFree(src->band);
+    }
+    if (src->scratch)
+        env.GlobalFree(src->scratch);
+    if (src->view)
+        env.UnmapViewOfFile(src->view);
+    if (src->gpbitmap) {
+        env.GdipDisposeImage(src->gpbitmap);
+        leanloader_env_deinit();
+    }
+    src->kind = 0;
+    src->scratch = 0;
+    src->view = 0;
+    src->gpbitmap = 0;
+}
+
+// routes pixel buffer allocations through alloc/free (pass zeroes to go back to GlobalAlloc).
+// alloc must return memory aligned to at least 16 bytes. set this before loading anything,
+// and don't change it while images allocated through it are still around.
+void leanloader_set_allocator(leanloader_alloc_t alloc, leanloader_free_t free, ptr userdata) {
+    env.alloc = alloc;
+    env.free = free;
+    env.allocdata = userdata;
+}
+
+// keeps GDI+ loaded and started until the matching leanloader_shutdown, so loads in between
+// don't restart it every time the last image is disposed of. returns nonzero on success.
+i32 leanloader_init() {
+    return leanloader_env_init() > 0;
+}
+
+// drops the reference taken by leanloader_init; GDI+ shuts down once no images use it either
+i32 leanloader_shutdown() {
+    return leanloader_env_deinit();
+}
+
+// leanloader_probe, with a LEANLOADER_ERROR_* in error when it fails
+static i32 leanloader_probe_file(wchar* name, u32* w, u32* h, u32* format, u32* error) {
+    u32 GENERIC_READ            = 0x80000000;
+    u32 FILE_SHARE_READ         = 0x00000001;
+    u32 OPEN_EXISTING           = 3;
+    u32 bw = 0, bh = 0, bf = 0;
+    i32 found = 0;
+    leanloader_kernel_init();
+    *error = LEANLOADER_ERROR_OPEN;
+    ptr file = env.CreateFileW(name, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, 0, 0);
+    if (file == (ptr)-1)
+        return 0;
+    *error = LEANLOADER_ERROR_FORMAT;
+    // enough for a BMP header with its masks, and for PNG's IHDR
+    u8 header[128];
+    u32 got = 0;
+    if (env.ReadFile(file, header, sizeof(header), &got, 0)) {
+        LEANLOADER_COUNT(bytesread, got);
+        found = leanloader_probe_header(header, got, &bw, &bh, &bf);
+    }
+    env.CloseHandle(file);
+    if (!found && !leanloader_env_init()) {
+        *error = LEANLOADER_ERROR_GDIPLUS;
+    } else if (!found) {
+        ptr image = 0;
+        u32 status = env.GdipLoadImageFromFile(name, &image);
+        if (status == 0) {
+            found = env.GdipGetImageWidth(image, &bw) == 0 &&
+                    env.GdipGetImageHeight(image, &bh) == 0 &&
+                    env.GdipGetImagePixelFormat(image, &bf) == 0;
+            env.GdipDisposeImage(image);
+        } else {
+            *error = leanloader_gdip_error(status);
+        }
+        leanloader_env_deinit();
+    }
+    if (found) {
+        *error = 0;
+        if (w)
+            *w = bw;
+        if (h)
+            *h = bh;
+        if (format)
+            *format = bf;
+    }
+    return found;
+}
+
+// gets the size and pixel format of an image file without decoding it: BMP and PNG headers
+// are read directly, anything else is opened with GDI+, which doesn't decode the pixels
+// until asked to. format receives a GDI+ PixelFormat value; any of the out pointers may be
+// null. returns nonzero on success.
+i32 leanloader_probe(wchar* name, u32* w, u32* h, u32* format) {
+    u32 error;
+    return leanloader_probe_file(name, w, h, format, &error);
+}
+
+// the part of leanloader_load that actually goes to the file
+static i32 leanloader_decode_file(leanloader_image_info* info) {
+    leanloader_reset(info);
+    leanloader_kernel_init();
+    // mapped even when GDI+ does the decoding, so it can be sniffed first
+    u64 size = 0;
+    u32 native = !(info->flags & LEANLOADER_NO_NATIVE);
+    u32 writecopy = native && (info->flags & LEANLOADER_MAPPED);
+    u8* view = leanloader_map(info->name, &size, writecopy);
+    if (view == 0) {
+        info->error = LEANLOADER_ERROR_OPEN;
+        return 0;
+    }
+    info->error = leanloader_sniff(view, size, info->maxpixels);
+    i32 loaded = 0;
+    if (native && !info->error) {
+        loaded = leanloader_native_decode(info, view, size, writecopy ? view : 0);
+        LEANLOADER_COUNT(native, loaded != 0);
+    }
+    if (info->storage != LEANLOADER_STORAGE_VIEW)
+        env.UnmapViewOfFile(view);
+    if (loaded || info->error)
+        return loaded;
+    if (!leanloader_env_init()) {
+        info->error = LEANLOADER_ERROR_GDIPLUS;
+        return 0;
+    }
+    info->envref = 1;
+    u32 status = env.GdipCreateBitmapFromFile(info->name, &info->gpbitmap);
+    LEANLOADER_COUNT(gdipfailures, status != 0);
+    if (status == 0 && leanloader_decode(info))
+        return 1;
+    if (status)
+        info->error = leanloader_gdip_error(status);
+    leanloader_env_deinit();
+    info->envref = 0;
+    return 0;
+}
+
+// leanloader_load_memory, for the formats the decoders produce themselves
+static i32 leanloader_decode_memory(leanloader_image_info* info, ptr data, u64 size) {
+    leanloader_reset(info);
+    leanloader_kernel_init();
+    info->error = leanloader_sniff(data, size, info->maxpixels);
+    if (!info->error && !(info->flags & LEANLOADER_NO_NATIVE) && leanloader_native_decode(info, data, size, 0))
+        return 1;
+    if (info->error)
+        return 0;
+    if (!leanloader_env_init()) {
+        info->error = LEANLOADER_ERROR_GDIPLUS;
+        return 0;
+    }
+    info->envref = 1;
+    ptr stream = leanloader_stream_create(data, size, 0);
+    info->error = LEANLOADER_ERROR_MEMORY;
+    if (stream) {
+        u32 status = env.GdipCreateBitmapFromStream(stream, &info->gpbitmap);
+        // GDI+ holds its own reference to the stream for as long as it needs it
+        leanloader_stream_release(stream);
+        info->error = 0;
+        if (status == 0 && leanloader_decode(info))
+            return 1;
+        if (status)
+            info->error = leanloader_gdip_error(status);
+    }
+    leanloader_env_deinit();
+    info->envref = 0;
+    return 0;
+}
+
+i32 leanloader_compress(leanloader_image_info* info, u32 format);
+static void leanloader_release(leanloader_image_info* info);
+
+// decodes the file, or data if it isn't null. block formats are decoded as ARGB, into a
+// buffer of our own even with dst set, and compressed from there; in dst, if there is one.
+// this is below the caches, so they keep the compressed blocks.
+static i32 leanloader_load_source(leanloader_image_info* info, u8* data, u64 size) {
+    u32 format = info->format;
+    if (!leanloader_format_block(format))
+        return data ? leanloader_decode_memory(info, data, size) : leanloader_decode_file(info);
+    ptr dst = info->dst;
+    info->format = LEANLOADER_FORMAT_ARGB;
+    info->dst = 0;
+    i32 loaded = data ? leanloader_decode_memory(info, data, size) : leanloader_decode_file(info);
+    info->format = format;
+    info->dst = dst;
+    if (loaded && !leanloader_compress(info, format)) {
+        u32 error = info->error;
+        leanloader_release(info);
+        info->error = error;
+        loaded = 0;
+    }
+    return loaded;
+}
+
+typedef struct {
+    u32 attributes;
+    u32 ctime[2];       // FILETIMEs
+    u32 atime[2];
+    u32 mtime[2];
+    u32 sizehigh;
+    u32 sizelow;
+} WIN32_FILE_ATTRIBUTE_DATA;
+
+// one decoded image in the cache. entries are on a hash chain for lookups and on a single
+// list in order of last use for eviction; both only change under the cache lock.
+typedef struct leanloader_cache_entry {
+    struct leanloader_cache_entry* next;    // hash chain
+    struct leanloader_cache_entry* newer;   // use order, toward cache.newest
+    struct leanloader_cache_entry* older;
+    u64 size;           // the file's size and last write time when it was decoded
+    u64 mtime;
+    u32 flags;          // the flags and format that change what the pixels look like
+    u32 format;
+    u32 hash;
+    u32 refcnt;         // images handed out and not yet disposed of
+    u64 bytes;          // what the pixels (mips included) count against the budget
+    leanloader_image_info image;
+    u32 namelen;
+    wchar name[];       // the full path, upper-cased
+} leanloader_cache_entry;
+
+#define LEANLOADER_CACHE_BUCKETS 1024
+
+typedef struct {
+    ptr lock;           // SRWLOCK over everything in here
+    u64 budget;         // 0 when the cache is off
+    u64 bytes;
+    leanloader_cache_entry* newest;
+    leanloader_cache_entry* oldest;
+    leanloader_cache_entry* buckets[LEANLOADER_CACHE_BUCKETS];
+} leanloader_cache_state;
+
+static leanloader_cache_state cache = {0};
+
+// the lookup key for a file: its full path, folded to upper case with forward slashes
+// turned around (so "a/b.png" and "A\B.PNG" are one entry), plus what the file system
+// says its size and last write time are.
+typedef struct {
+    wchar* name;
+    u32 namelen;
+    u64 size;
+    u64 mtime;
+    u32 flags;
+    u32 format;
+    u32 hash;
+    wchar buffer[520];  // name points here unless the path is longer
+} leanloader_cache_key;
+
+static i32 leanloader_cache_key_init(leanloader_cache_key* key, leanloader_image_info* info) {
+    u32 GetFileExInfoStandard = 0;
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!env.GetFileAttributesExW(info->name, GetFileExInfoStandard, &data))
+        return 0;
+    key->size = (u64)data.sizehigh << 32 | data.sizelow;
+    key->mtime = (u64)data.mtime[1] << 32 | data.mtime[0];
+    key->flags = info->flags & (LEANLOADER_NO_NATIVE | LEANLOADER_MIPMAPS | LEANLOADER_MIPMAPS_SRGB);
+    key->format = leanloader_format(info);
+    key->name = key->buffer;
+    u32 len = env.GetFullPathNameW(info->name, sizeof(key->buffer) / sizeof(wchar), key->buffer, 0);
+    if (len >= sizeof(key->buffer) / sizeof(wchar)) {
+        // too long for the stack, len is the size needed (terminator included)
+        key->name = env.GlobalAlloc(0, (u64)len * sizeof(wchar));
+        if (key->name)
+            len = env.GetFullPathNameW(info->name, len, key->name, 0);
+    }
+    if (!key->name || len == 0)
+        return 0;
+    key->namelen = len;
+    u32 hash = 2166136261u;     // FNV-1a
+    for (u32 i = 0; i < len; i++) {
+        wchar c = key->name[i];
+        if (c >= 'a' && c <= 'z')
+            c -= 'a' - 'A';
+        else if (c == '/')
+            c = '\\';
+        key->name[i] = c;
+        hash = (hash ^ c) * 16777619u;
+    }
+    u64 mix[2] = {key->size ^ key->mtime, (u64)key->flags << 32 | key->format};
+    for (u32 i = 0; i < 2; i++)
+        hash = (hash ^ (u32)mix[i] ^ (u32)(mix[i] >> 32)) * 16777619u;
+    key->hash = hash;
+    return 1;
+}
+
+static void leanloader_cache_key_free(leanloader_cache_key* key) {
+    if (key->name && key->name != key->buffer)
+        env.GlobalFree(key->name);
+}
+
+// the header of a blob in the disk cache. the mip table (mips entries) and the source's
+// full path follow it, then the pixels at the next multiple of 64, laid out and padded
+// exactly like one of our pixel buffers.
+typedef struct {
+    u32 magic;          // LEANLOADER_BLOB_MAGIC
+    u32 namelen;
+    u64 size;           // the source file's size and last write time, as in the key
+    u64 mtime;
+    u32 flags;
+    u32 format;
+    u32 w;
+    u32 h;
+    i32 stride;
+    u32 mips;
+    u64 pixels;         // file offset of the pixels
+    u64 bytes;          // size of the pixels, padding included
+} leanloader_blob;
+
+#define LEANLOADER_BLOB_MAGIC 0x31434c4c    // "LLC1"
+
+// dir\xxxxxxxx.llc (or .tmp, while it's being written) for key. GlobalFree the result.
+static wchar* leanloader_blob_name(leanloader_cache_key* key, u32 tmp) {
+    u32 dirlen = 0;
+    while (env.cachedir[dirlen])
+        dirlen++;
+    wchar* name = env.GlobalAlloc(0, (u64)(dirlen + 14) * sizeof(wchar));
+    if (!name)
+        return 0;
+    wchar* p = name;
+    for (u32 i = 0; i < dirlen; i++)
+        *p++ = env.cachedir[i];
+    if (dirlen && p[-1] != '\\' && p[-1] != '/')
+        *p++ = '\\';
+    for (i32 shift = 28; shift >= 0; shift -= 4)
+        *p++ = "0123456789abcdef"[key->hash >> shift & 15];
+    char* ext = tmp ? ".tmp" : ".llc";
+    for (u32 i = 0; i < 5; i++)
+        *p++ = ext[i];
+    return name;
+}
+
+// whether a w x h level of format with rows stride bytes apart fits in size bytes
+static i32 leanloader_blob_level(u32 format, u32 w, u32 h, i32 stride, u64 size) {
+    u32 blockbytes = leanloader_format_block(format);
+    u64 rowbytes = blockbytes ? (u64)(w + 3) / 4 * blockbytes : (u64)w * leanloader_format_bytes(format);
+    u64 rows = blockbytes ? (h + 3) / 4 : h;
+    return w && h && rowbytes && stride > 0 && (u64)stride >= rowbytes && (u64)stride * (rows - 1) + rowbytes <= size;
+}
+
+// maps the blob for key and points info at the pixels in it, copy-on-write, so the image
+// can be written to like any other. anything off about the blob makes it a miss.
+static i32 leanloader_blob_load(leanloader_image_info* info, leanloader_cache_key* key) {
+    wchar* name = leanloader_blob_name(key, 0);
+    if (!name)
+        return 0;
+    u64 size = 0;
+    u8* view = leanloader_map(name, &size, 1);
+    env.GlobalFree(name);
+    if (!view)
+        return 0;
+    leanloader_blob* blob = (leanloader_blob*)view;
+    u64 table = sizeof(leanloader_blob);
+    if (size < table || blob->magic != LEANLOADER_BLOB_MAGIC || blob->size != key->size ||
+        blob->mtime != key->mtime || blob->flags != key->flags || blob->format != key->format ||
+        blob->namelen != key->namelen || blob->mips > LEANLOADER_MAX_MIPS)
+        goto miss;
+    u64 names = table + (u64)blob->mips * sizeof(leanloader_mip);
+    u64 end = names + (u64)blob->namelen * sizeof(wchar);
+    u32 rows = leanloader_format_block(blob->format) ? (blob->h + 3) / 4 : blob->h;
+    if (blob->pixels < end || blob->pixels % 64 || size < blob->pixels || blob->bytes > size - blob->pixels ||
+        !leanloader_blob_level(blob->format, blob->w, blob->h, blob->stride, blob->bytes) ||
+        (u64)blob->stride * rows > blob->bytes)
+        goto miss;
+    wchar* blobname = (wchar*)(view + names);
+    for (u32 i = 0; i < key->namelen; i++)
+        if (blobname[i] != key->name[i])
+            goto miss;
+    leanloader_mip* mip = (leanloader_mip*)(view + table);
+    for (u32 i = 0; i < blob->mips; i++)
+        if (mip[i].offset > blob->bytes || mip[i].size > blob->bytes - mip[i].offset ||
+            !leanloader_blob_level(blob->format, mip[i].w, mip[i].h, mip[i].stride, mip[i].size))
+            goto miss;
+    info->bd.w = blob->w;
+    info->bd.h = blob->h;
+    info->bd.stride = blob->stride;
+    info->bd.PixelFormat = blob->format;
+    info->bd.ptr = view + blob->pixels;
+    info->mips = blob->mips;
+    leanloader_copy(info->mip, mip, (u64)blob->mips * sizeof(leanloader_mip));
+    info->storage = LEANLOADER_STORAGE_VIEW;
+    info->view = view;
+    return 1;
+miss:
+    env.UnmapViewOfFile(view);
+    return 0;
+}
+
+static i32 leanloader_write(ptr file, u8* data, u64 size) {
+    while (size) {
+        u32 chunk = size > 0x40000000 ? 0x40000000 : (u32)size;
+        u32 written = 0;
+        if (!env.WriteFile(file, data, chunk, &written, 0) || written != chunk)
+            return 0;
+        data += chunk;
+        size -= chunk;
+    }
+    return 1;
+}
+
+// writes a freshly loaded image out as the blob for key. it goes to a temporary file first
+// and is renamed into place when complete, so a reader never maps half a blob; a writer
+// already busy with the same one makes us skip it. failures just mean no blob.
+static void leanloader_blob_store(leanloader_image_info* info, leanloader_cache_key* key) {
+    u32 GENERIC_WRITE               = 0x40000000;
+    u32 CREATE_ALWAYS               = 2;
+    u32 FILE_ATTRIBUTE_NORMAL       = 0x80;
+    u32 MOVEFILE_REPLACE_EXISTING   = 0x1;
+    u64 bytes = leanloader_image_bytes(info);
+    if (!info->bd.ptr || info->bd.stride <= 0)
+        return;
+    u64 names = sizeof(leanloader_blob) + (u64)info->mips * sizeof(leanloader_mip);
+    u64 pixels = names + (u64)key->namelen * sizeof(wchar) + 63 & ~(u64)63;
+    u8* head = env.GlobalAlloc(0x0040, pixels);    // GPTR
+    wchar* tmpname = leanloader_blob_name(key, 1);
+    wchar* name = leanloader_blob_name(key, 0);
+    if (head && tmpname && name) {
+        leanloader_blob* blob = (leanloader_blob*)head;
+        blob->magic = LEANLOADER_BLOB_MAGIC;
+        blob->namelen = key->namelen;
+        blob->size = key->size;
+        blob->mtime = key->mtime;
+        blob->flags = key->flags;
+        blob->format = key->format;
+        blob->w = info->bd.w;
+        blob->h = info->bd.h;
+        blob->stride = info->bd.stride;
+        blob->mips = info->mips;
+        blob->pixels = pixels;
+        blob->bytes = bytes + 63 & ~(u64)63;
+        leanloader_copy(head + sizeof(leanloader_blob), info->mip, (u64)info->mips * sizeof(leanloader_mip));
+        leanloader_copy(head + names, key->name, (u64)key->namelen * sizeof(wchar));
+        // no sharing: a second writer fails to open it and leaves the blob to us
+        ptr file = env.CreateFileW(tmpname, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0);
+        if (file != (ptr)-1) {
+            u8 zeros[64] = {0};
+            i32 ok = leanloader_write(file, head, pixels) &&
+                     leanloader_write(file, info->bd.ptr, bytes) &&
+                     leanloader_write(file, zeros, blob->bytes - bytes);
+            env.CloseHandle(file);
+            if (!ok || !env.MoveFileExW(tmpname, name, MOVEFILE_REPLACE_EXISTING))
+                env.DeleteFileW(tmpname);
+        }
+    }
+    if (head)
+        env.GlobalFree(head);
+    if (tmpname)
+        env.GlobalFree(tmpname);
+    if (name)
+        env.GlobalFree(name);
+}
+
+// leanloader_load_source, but through the disk cache when LEANLOADER_DISK_CACHED asks for it
+static i32 leanloader_load_disk(leanloader_image_info* info) {
+    if (!(info->flags & LEANLOADER_DISK_CACHED) || !env.cachedir || info->dst)
+        return leanloader_load_source(info, 0, 0);
+    leanloader_reset(info);
+    leanloader_kernel_init();
+    leanloader_cache_key key;
+    key.name = 0;
+    i32 loaded = 0;
+    if (leanloader_cache_key_init(&key, info)) {
+        loaded = leanloader_blob_load(info, &key);
+        LEANLOADER_COUNT(diskhits, loaded);
+        if (!loaded) {
+            loaded = leanloader_load_source(info, 0, 0);
+            if (loaded)
+                leanloader_blob_store(info, &key);
+        }
+    } else {
+        loaded = leanloader_load_source(info, 0, 0);
+    }
+    leanloader_cache_key_free(&key);
+    return loaded;
+}
+
+// finds the entry for key, with the lock held
+static leanloader_cache_entry* leanloader_cache_find(leanloader_cache_key* key) {
+    leanloader_cache_entry* e = cache.buckets[key->hash % LEANLOADER_CACHE_BUCKETS];
+    for (; e; e = e->next) {
+        if (e->hash != key->hash || e->size != key->size || e->mtime != key->mtime ||
+            e->flags != key->flags || e->format != key->format || e->namelen != key->namelen)
+            continue;
+        u32 i = 0;
+        while (i < key->namelen && e->name[i] == key->name[i])
+            i++;
+        if (i == key->namelen)
+            return e;
+    }
+    return 0;
+}
+
+// moves e to the newest end of the use order, with the lock held. e may be on it already.
+static void leanloader_cache_touch(leanloader_cache_entry* e, u32 linked) {
+    if (linked) {
+        if (cache.newest == e)
+            return;
+        if (e->older)
+            e->older->newer = e->newer;
+        else
+            cache.oldest = e->newer;
+        e->newer->older = e->older;
+    }
+    e->newer = 0;
+    e->older = cache.newest;
+    if (cache.newest)
+        cache.newest->newer = e;
+    else
+        cache.oldest = e;
+    cache.newest = e;
+}
+
+// unlinks unreferenced entries, oldest first, until the cache fits its budget again, with
+// the lock held. they're returned chained through next, to be freed once the lock is let go.
+static leanloader_cache_entry* leanloader_cache_trim() {
+    leanloader_cache_entry* evicted = 0;
+    leanloader_cache_entry* e = cache.oldest;
+    while (e && cache.bytes > cache.budget) {
+        leanloader_cache_entry* newer = e->newer;
+        if (e->refcnt == 0) {
+            leanloader_cache_entry** link = &cache.buckets[e->hash % LEANLOADER_CACHE_BUCKETS];
+            while (*link != e)
+                link = &(*link)->next;
+            *link = e->next;
+            if (e->older)
+                e->older->newer = e->newer;
+            else
+                cache.oldest = e->newer;
+            if (e->newer)
+                e->newer->older = e->older;
+            else
+                cache.newest = e->older;
+            cache.bytes -= e->bytes;
+            e->next = evicted;
+            evicted = e;
+        }
+        e = newer;
+    }
+    return evicted;
+}
+
+static void leanloader_cache_free(leanloader_cache_entry* evicted) {
+    while (evicted) {
+        leanloader_cache_entry* next = evicted->next;
+        leanloader_free_pixels(&evicted->image);
+        env.GlobalFree(evicted);
+        evicted = next;
+    }
+}
+
+// gives info its own reference on e's pixels, with the lock held
+static i32 leanloader_cache_share(leanloader_image_info* info, leanloader_cache_entry* e) {
+    e->refcnt++;
+    info->bd = e->image.bd;
+    info->mips = e->image.mips;
+    leanloader_copy(info->mip, e->image.mip, (u64)e->image.mips * sizeof(leanloader_mip));
+    info->storage = LEANLOADER_STORAGE_CACHE;
+    info->cache = e;
+    return 1;
+}
+
+// dispose's end of the above
+static void leanloader_cache_release(ptr entry) {
+    leanloader_cache_entry* e = entry;
+    env.AcquireSRWLockExclusive(&cache.lock);
+    e->refcnt--;
+    leanloader_cache_entry* evicted = leanloader_cache_trim();
+    env.ReleaseSRWLockExclusive(&cache.lock);
+    leanloader_cache_free(evicted);
+}
+
+// leanloader_load for LEANLOADER_CACHED. a miss decodes into a new entry without holding
+// the lock; if another thread got the same file in meanwhile, its entry wins and ours goes.
+// an image too big for the budget is handed over as a private (detached) one instead.
+static i32 leanloader_cache_load(leanloader_image_info* info) {
+    leanloader_reset(info);
+    leanloader_kernel_init();
+    leanloader_cache_key key;
+    key.name = 0;
+    if (!__atomic_load_n(&cache.budget, __ATOMIC_RELAXED) || !leanloader_cache_key_init(&key, info)) {
+        leanloader_cache_key_free(&key);
+        return leanloader_load_disk(info);
+    }
+    env.AcquireSRWLockExclusive(&cache.lock);
+    leanloader_cache_entry* e = leanloader_cache_find(&key);
+    if (e) {
+        leanloader_cache_touch(e, 1);
+        leanloader_cache_share(info, e);
+    }
+    env.ReleaseSRWLockExclusive(&cache.lock);
+    LEANLOADER_COUNT(cachehits, e != 0);
+    if (e) {
+        leanloader_cache_key_free(&key);
+        return 1;
+    }
+
+    u32 GPTR = 0x0040;
+    e = env.GlobalAlloc(GPTR, sizeof(leanloader_cache_entry) + (u64)key.namelen * sizeof(wchar));
+    if (!e) {
+        leanloader_cache_key_free(&key);
+        return leanloader_load_disk(info);
+    }
+    e->size = key.size;
+    e->mtime = key.mtime;
+    e->flags = key.flags;
+    e->format = key.format;
+    e->hash = key.hash;
+    e->namelen = key.namelen;
+    leanloader_copy(e->name, key.name, (u64)key.namelen * sizeof(wchar));
+    // the entry's copy never goes back to GDI+, so it doesn't keep it running either
+    leanloader_image_info* image = &e->image;
+    image->name = info->name;
+    image->flags = (info->flags & ~LEANLOADER_CACHED) | LEANLOADER_DETACHED;
+    image->format = info->format;
+    image->maxpixels = info->maxpixels;
+    i32 loaded = leanloader_load_disk(image);
+    info->error = image->error;
+    if (image->envref) {
+        leanloader_env_deinit();
+        image->envref = 0;
+    }
+    image->name = 0;
+    if (loaded) {
+        e->bytes = leanloader_image_bytes(image);
+        leanloader_cache_entry* evicted = 0;
+        env.AcquireSRWLockExclusive(&cache.lock);
+        leanloader_cache_entry* found = leanloader_cache_find(&key);
+        if (found) {
+            leanloader_cache_touch(found, 1);
+            leanloader_cache_share(info, found);
+        } else if (e->bytes <= cache.budget) {
+            u32 bucket = e->hash % LEANLOADER_CACHE_BUCKETS;
+            e->next = cache.buckets[bucket];
+            cache.buckets[bucket] = e;
+            leanloader_cache_touch(e, 0);
+            cache.bytes += e->bytes;
+            leanloader_cache_share(info, e);
+            evicted = leanloader_cache_trim();
+            e = 0;
+        }
+        env.ReleaseSRWLockExclusive(&cache.lock);
+        leanloader_cache_free(evicted);
+        if (e && !found) {
+            info->bd = image->bd;
+            info->storage = image->storage;
+            info->view = image->view;
+            info->allocsize = image->allocsize;
+            info->mips = image->mips;
+            leanloader_copy(info->mip, image->mip, sizeof(info->mip));
+            image->bd.ptr = 0;
+        }
+    }
+    leanloader_cache_key_free(&key);
+    if (e) {
+        leanloader_free_pixels(&e->image);
+        env.GlobalFree(e);
+    }
+    return loaded;
+}
+
+// turns on the process-wide decoded image cache for loads with LEANLOADER_CACHED set, and
+// sets how many bytes of pixels it may keep around; 0 turns it off again. entries no image
+// refers to anymore are evicted least recently used first once the cache is over budget.
+// images still in use are never evicted (and may push the cache over), and every cached
+// entry is dropped once disposed of while the cache is off.
+void leanloader_cache_budget(u64 bytes) {
+    leanloader_kernel_init();
+    env.AcquireSRWLockExclusive(&cache.lock);
+    __atomic_store_n(&cache.budget, bytes, __ATOMIC_RELAXED);
+    leanloader_cache_entry* evicted = leanloader_cache_trim();
+    env.ReleaseSRWLockExclusive(&cache.lock);
+    leanloader_cache_free(evicted);
+}
+
+// turns on the buffer pool and sets how many bytes of disposed pixel buffers it may hold on
+// to, for later loads that need a buffer of the same size; 0 turns it off and frees them all.
+// a buffer that doesn't fit the budget anymore is freed as usual. only GlobalAlloc buffers
+// are pooled, not the ones from the allocator hooks or large pages.
+void leanloader_pool_budget(u64 bytes) {
+    leanloader_kernel_init();
+    leanloader_pooled* freed = 0;
+    env.AcquireSRWLockExclusive(&pool.lock);
+    __atomic_store_n(&pool.budget, bytes, __ATOMIC_RELAXED);
+    for (u32 i = 0; i < LEANLOADER_POOL_BUCKETS && pool.bytes > bytes; i++) {
+        while (pool.buckets[i] && pool.bytes > bytes) {
+            leanloader_pooled* p = pool.buckets[i];
+            pool.buckets[i] = p->next;
+            pool.bytes -= p->size;
+            p->next = freed;
+            freed = p;
+        }
+    }
+    env.ReleaseSRWLockExclusive(&pool.lock);
+    while (freed) {
+        leanloader_pooled* p = freed;
+        freed = p->next;
+        env.GlobalFree(p);
+    }
+}
+
+// sets the directory the disk cache keeps its blobs in, for loads with LEANLOADER_DISK_CACHED
+// set (0 turns it off). the directory must exist, and the string must stay valid while the
+// cache is in use. set this before loading anything, like the allocator hooks. a blob is
+// the output of a load as is, so it only depends on the source file, the format and the
+// mip flags; files that have changed since are decoded again, and their blob replaced.
+void leanloader_cache_dir(wchar* dir) {
+    env.cachedir = dir;
+}
+
+static void leanloader_deferred_drop(leanloader_image_info* info);
+
+// the LEANLOADER_DEFERRED half of leanloader_load: the header alone, which is all the
+// struct describes until leanloader_pixels brings the pixels in
+static i32 leanloader_load_header(leanloader_image_info* info) {
+    // the pixels from before would be left on the list with nothing to show for them
+    leanloader_deferred_drop(info);
+    leanloader_reset(info);
+    info->bd.stride = 0;
+    info->bd.PixelFormat = leanloader_format(info);
+    return leanloader_probe_file(info->name, &info->bd.w, &info->bd.h, 0, &info->error);
+}
+
+// leanloader_load, with header saying whether it's just the header (LEANLOADER_DEFERRED)
+static i32 leanloader_load_as(leanloader_image_info* info, u32 header) {
+    u64 ticks = LEANLOADER_TICKS();
+    i32 loaded;
+    if (header)
+        loaded = leanloader_load_header(info);
+    else if ((info->flags & LEANLOADER_CACHED) && !info->dst)
+        loaded = leanloader_cache_load(info);
+    else
+        loaded = leanloader_load_disk(info);
+    // the caches hand out what they have without looking at the file again
+    if (loaded && info->maxpixels && (u64)info->bd.w * info->bd.h > info->maxpixels) {
+        leanloader_free_pixels(info);
+        info->error = LEANLOADER_ERROR_TOO_BIG;
+        loaded = 0;
+    }
+    LEANLOADER_COUNT(loads, 1);
+    LEANLOADER_COUNT(failures, !loaded);
+    LEANLOADER_COUNT(pixels, loaded ? (u64)info->bd.w * info->bd.h : 0);
+    LEANLOADER_COUNT(loadticks, LEANLOADER_TICKS() - ticks);
+    return loaded;
+}
+
+// one of the two main functions, this one loads the image specified in the info struct
+i32 leanloader_load(leanloader_image_info* info) {
+    return leanloader_load_as(info, (info->flags & LEANLOADER_DEFERRED) != 0);
+}
+
+// copies the counters into stats (see LEANLOADER_STATS at the top). returns 0, with stats
+// zeroed, if they weren't compiled in.
+i32 leanloader_get_stats(leanloader_stats* stats) {
+#if LEANLOADER_STATS
+    u64* src = (u64*)&leanloader_counters;
+    u64* dst = (u64*)stats;
+    for (u32 i = 0; i < sizeof(leanloader_stats) / sizeof(u64); i++)
+        dst[i] = __atomic_load_n(&src[i], __ATOMIC_RELAXED);
+    return 1;
+#else
+    leanloader_fill(stats, 0, sizeof(leanloader_stats));
+    return 0;
+#endif
+}
+
+// same as leanloader_load, but decodes an image file that's already in memory (the name
+// field is ignored.) no copy of the data is made: unless LEANLOADER_DETACHED is set, the
+// memory must stay valid until leanloader_dispose, as GDI+ may go back to it at any time.
+i32 leanloader_load_memory(leanloader_image_info* info, ptr data, u64 size) {
+    return leanloader_load_source(info, data, size);
+}
+
+// same as leanloader_load, but decodes straight into dst (size bytes), pitch bytes from one
+// row to the next; pitch is anything at least as wide as a row, 256-byte aligned D3D12
+// upload rows say. the GDI+ bitmap is always detached, so nothing ever reads dst back or
+// writes to it after this returns. leanloader_probe tells you how big to make it first.
+i32 leanloader_load_into(leanloader_image_info* info, ptr dst, i32 pitch, u64 size) {
+    info->dst = dst;
+    info->dststride = pitch;
+    info->dstsize = size;
+    // detached for this load only, the struct may go on to be used for others
+    u32 flags = info->flags;
+    info->flags |= LEANLOADER_DETACHED;
+    i32 loaded = leanloader_load(info);
+    info->flags = flags;
+    return loaded;
+}
+
+// everything leanloader_dispose gives back, which leaves the struct as a failed load would
+static void leanloader_release(leanloader_image_info* info) {
+    if (info->gpbitmap) {
+        if (info->bd.ptr)
+            env.GdipBitmapUnlockBits(info->gpbitmap, &info->bd);
+        env.GdipDisposeImage(info->gpbitmap);
+        info->gpbitmap = 0;
+    }
+    // detached and natively decoded images get here with no bitmap, but still own the pixels
+    leanloader_free_pixels(info);
+    if (info->envref) {
+        leanloader_env_deinit();
+        info->envref = 0;
+    }
+}
+
+// the LEANLOADER_DEFERRED images that have their pixels in, most recently used first. an
+// image is on the list exactly when its resident field is nonzero, and evicting one (which
+// can happen from any thread's leanloader_pixels) only happens under the lock, as does
+// disposing of one, so the two never meet halfway. an image being decoded isn't on the
+// list yet, but has loading set (under the lock too), and anyone else after it waits.
+typedef struct {
+    ptr lock;           // SRWLOCK over everything in here, and the images' loading fields
+    ptr cond;           // CONDITION_VARIABLE, for any image's loading going back to 0
+    u64 budget;         // 0 for no limit
+    u64 bytes;
+    leanloader_image_info* newest;
+    leanloader_image_info* oldest;
+} leanloader_deferred_state;
+
+static leanloader_deferred_state deferred = {0};
+
+static void leanloader_deferred_unlink(leanloader_image_info* info) {
+    leanloader_image_info* newer = info->newer;
+    leanloader_image_info* older = info->older;
+    if (newer)
+        newer->older = older;
+    else
+        deferred.newest = older;
+    if (older)
+        older->newer = newer;
+    else
+        deferred.oldest = newer;
+    info->newer = 0;
+    info->older = 0;
+    deferred.bytes -= info->resident;
+    info->resident = 0;
+}
+
+static void leanloader_deferred_push(leanloader_image_info* info, u64 bytes) {
+    info->newer = 0;
+    info->older = deferred.newest;
+    if (deferred.newest)
+        deferred.newest->newer = info;
+    else
+        deferred.oldest = info;
+    deferred.newest = info;
+    info->resident = bytes;
+    deferred.bytes += bytes;
+}
+
+// back to the header only: the size stays, everything else goes
+static void leanloader_deferred_evict(leanloader_image_info* info) {
+    leanloader_deferred_unlink(info);
+    leanloader_release(info);
+    info->bd.stride = 0;
+    info->mips = 0;
+}
+
+// evicts the least recently used images until the rest fit the budget, keeping keep and
+// anything pinned
+static void leanloader_deferred_trim(leanloader_image_info* keep) {
+    leanloader_image_info* e = deferred.oldest;
+    while (e && deferred.budget && deferred.bytes > deferred.budget) {
+        leanloader_image_info* newer = e->newer;
+        if (e != keep && e->pins == 0)
+            leanloader_deferred_evict(e);
+        e = newer;
+    }
+}
+
+// leanloader_pixels and leanloader_pin; pin is 1 to pin the image if the pixels are had
+static ptr leanloader_deferred_pixels(leanloader_image_info* info, u32 pin) {
+    if (!(info->flags & LEANLOADER_DEFERRED))
+        return info->bd.ptr;
+    u32 INFINITE = 0xffffffff;
+    ptr pixels = 0;
+    leanloader_kernel_init();
+    env.AcquireSRWLockExclusive(&deferred.lock);
+    // some other thread is decoding it already; what it ends up with will do for us too
+    while (info->loading)
+        env.SleepConditionVariableSRW(&deferred.cond, &deferred.lock, INFINITE, 0);
+    if (info->resident) {
+        u64 bytes = info->resident;
+        leanloader_deferred_unlink(info);
+        leanloader_deferred_push(info, bytes);
+        info->pins += pin;
+        pixels = info->bd.ptr;
+    } else if (info->bd.ptr) {
+        // loaded some other way (leanloader_load_memory, say), and not ours to evict
+        pixels = info->bd.ptr;
+    }
+    if (pixels) {
+        env.ReleaseSRWLockExclusive(&deferred.lock);
+        return pixels;
+    }
+    // not on the list, and loading keeps everyone else off it until it is
+    info->loading = 1;
+    env.ReleaseSRWLockExclusive(&deferred.lock);
+    i32 loaded = leanloader_load_as(info, 0);
+    u64 bytes = loaded ? leanloader_image_bytes(info) : 0;
+    env.AcquireSRWLockExclusive(&deferred.lock);
+    if (loaded) {
+        leanloader_deferred_push(info, bytes ? bytes : 1);
+        info->pins += pin;
+        leanloader_deferred_trim(info);
+        pixels = info->bd.ptr;
+    }
+    info->loading = 0;
+    env.WakeAllConditionVariable(&deferred.cond);
+    env.ReleaseSRWLockExclusive(&deferred.lock);
+    return pixels;
+}
+
+// returns the pixels of an image loaded with LEANLOADER_DEFERRED, decoding them first if
+// they aren't in (anymore), or 0 if that fails, with the reason in the error field. the
+// struct then describes the image as leanloader_load would have. with a deferred budget
+// set, any thread's leanloader_pixels may evict other images to make room, so get the
+// pointer afresh before each use rather than keeping it around, or use leanloader_pin.
+// if another thread is decoding the same image already, this waits for it to finish. for
+// any other image it just returns bd.ptr.
+ptr leanloader_pixels(leanloader_image_info* info) {
+    return leanloader_deferred_pixels(info, 0);
+}
+
+// same as leanloader_pixels, but on success the image also stays in, budget or not, until
+// a matching leanloader_unpin, so the pointer may be used from any thread until then.
+// pins nest.
+ptr leanloader_pin(leanloader_image_info* info) {
+    return leanloader_deferred_pixels(info, 1);
+}
+
+// undoes one leanloader_pin. an image left over the budget by its pin may go right away.
+void leanloader_unpin(leanloader_image_info* info) {
+    if (!(info->flags & LEANLOADER_DEFERRED))
+        return;
+    leanloader_kernel_init();
+    env.AcquireSRWLockExclusive(&deferred.lock);
+    if (info->pins && --info->pins == 0)
+        leanloader_deferred_trim(0);
+    env.ReleaseSRWLockExclusive(&deferred.lock);
+}
+
+// drops the pixels of a LEANLOADER_DEFERRED image, leaving it as leanloader_load did; the
+// next leanloader_pixels decodes them again. does nothing to any other image, or to a
+// pinned one.
+void leanloader_evict(leanloader_image_info* info) {
+    if (!(info->flags & LEANLOADER_DEFERRED))
+        return;
+    leanloader_kernel_init();
+    env.AcquireSRWLockExclusive(&deferred.lock);
+    if (info->resident && info->pins == 0)
+        leanloader_deferred_evict(info);
+    env.ReleaseSRWLockExclusive(&deferred.lock);
+}
+
+// sets how many bytes of pixels LEANLOADER_DEFERRED images may hold at once (0, the
+// default, for no limit); past that, leanloader_pixels evicts the ones used longest ago.
+// lowering it evicts right away.
+void leanloader_deferred_budget(u64 bytes) {
+    leanloader_kernel_init();
+    env.AcquireSRWLockExclusive(&deferred.lock);
+    deferred.budget = bytes;
+    leanloader_deferred_trim(0);
+    env.ReleaseSRWLockExclusive(&deferred.lock);
+}
+
+// takes info off the list, once any leanloader_pixels decoding it is done, and gives back
+// the pixels it had in. pins go too.
+static void leanloader_deferred_drop(leanloader_image_info* info) {
+    u32 INFINITE = 0xffffffff;
+    leanloader_kernel_init();
+    env.AcquireSRWLockExclusive(&deferred.lock);
+    while (info->loading)
+        env.SleepConditionVariableSRW(&deferred.cond, &deferred.lock, INFINITE, 0);
+    if (info->resident) {
+        leanloader_deferred_unlink(info);
+        leanloader_release(info);
+    }
+    info->pins = 0;
+    env.ReleaseSRWLockExclusive(&deferred.lock);
+}
+
+// the other main function, this one frees the resources allocated by leanloader_load
+i32 leanloader_dispose(leanloader_image_info* info) {
+    u64 ticks = LEANLOADER_TICKS();
+    // off the list first; then it's ours alone, like any other image
+    if (info->flags & LEANLOADER_DEFERRED)
+        leanloader_deferred_drop(info);
+    leanloader_release(info);
+    LEANLOADER_COUNT(disposes, 1);
+    LEANLOADER_COUNT(disposeticks, LEANLOADER_TICKS() - ticks);
+    return 0;
+}
+
+// the kernels behind leanloader_convert. each one works through n pixels in place; the SIMD
+// versions only ever do whole 64-byte blocks (n is a multiple of 16), and the scalar ones
+// pick up the rest of a row where there's no padding to run into.
+typedef void (*leanloader_kernel_t)(u32* p, u64 n);
+
+static void leanloader_swizzle_scalar(u32* p, u64 n) {
+    for (u64 i = 0; i < n; i++) {
+        u32 x = p[i];
+        p[i] = (x & 0xff00ff00) | (x >> 16 & 0xff) | (x & 0xff) << 16;
+    }
+}
+
+static void leanloader_premultiply_scalar(u32* p, u64 n) {
+    for (u64 i = 0; i < n; i++)
+        p[i] = leanloader_premultiply1(p[i]);
+}
+
+// c * 255 / a, rounded and clamped; fully transparent pixels end up all zeroes
+static void leanloader_unpremultiply_scalar(u32* p, u64 n) {
+    for (u64 i = 0; i < n; i++) {
+        u32 x = p[i];
+        u32 a = x >> 24;
+        if (a == 255)
+            continue;
+        u32 out = 0;
+        if (a) {
+            out = x & 0xff000000;
+            for (u32 shift = 0; shift < 24; shift += 8) {
+                u32 c = ((x >> shift & 0xff) * 255 + a / 2) / a;
+                out |= (c > 255 ? 255 : c) << shift;
+            }
+        }
+        p[i] = out;
+    }
+}
+
+// round(255 * linear(i / 255)) per the sRGB transfer function
+static u8 leanloader_srgb_linear[256] = {
+      0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,   1,   1,   1,   1,   1,
+      1,   1,   2,   2,   2,   2,   2,   2,   2,   2,   3,   3,   3,   3,   3,   3,
+      4,   4,   4,   4,   4,   5,   5,   5,   5,   6,   6,   6,   6,   7,   7,   7,
+      8,   8,   8,   8,   9,   9,   9,  10,  10,  10,  11,  11,  12,  12,  12,  13,
+     13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  17,  18,  18,  19,  19,  20,
+     20,  21,  22,  22,  23,  23,  24,  24,  25,  25,  26,  27,  27,  28,  29,  29,
+     30,  30,  31,  32,  32,  33,  34,  35,  35,  36,  37,  37,  38,  39,  40,  41,
+     41,  42,  43,  44,  45,  45,  46,  47,  48,  49,  50,  51,  51,  52,  53,  54,
+     55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  65,  66,  67,  68,  69,  70,
+     71,  72,  73,  74,  76,  77,  78,  79,  80,  81,  82,  84,  85,  86,  87,  88,
+     90,  91,  92,  93,  95,  96,  97,  99, 100, 101, 103, 104, 105, 107, 108, 109,
+    111, 112, 114, 115, 116, 118, 119, 121, 122, 124, 125, 127, 128, 130, 131, 133,
+    134, 136, 138, 139, 141, 142, 144, 146, 147, 149, 151, 152, 154, 156, 157, 159,
+    161, 163, 164, 166, 168, 170, 171, 173, 175, 177, 179, 181, 183, 184, 186, 188,
+    190, 192, 194, 196, 198, 200, 202, 204, 206, 208, 210, 212, 214, 216, 218, 220,
+    222, 224, 226, 229, 231, 233, 235, 237, 239, 242, 244, 246, 248, 250, 253, 255,
+};
+
+// a table lookup per byte doesn't get any faster with vectors short of VBMI, so this one has
+// no SIMD versions
+static void leanloader_linearize_scalar(u32* p, u64 n) {
+    u8* t = leanloader_srgb_linear;
+    for (u64 i = 0; i < n; i++) {
+        u32 x = p[i];
+        p[i] = (x & 0xff000000) | (u32)t[x >> 16 & 0xff] << 16 | (u32)t[x >> 8 & 0xff] << 8 | t[x & 0xff];
+    }
+}
+
+#if defined(__SSE2__)
+// the same three kernels at each instruction set level. the premultiply is exact: with
+// t = c * a + 128, (t * 257) >> 16 is t / 255 rounded, for every c and a. the unpremultiply
+// divides in floats, which for numbers this small truncates to the same integer quotient.
+__attribute__((target("sse2")))
+static void leanloader_swizzle_sse2(u32* p, u64 n) {
+    __m128i ag = _mm_set1_epi32(0xff00ff00);
+    __m128i lo = _mm_set1_epi32(0xff);
+    for (u64 i = 0; i < n; i += 4) {
+        __m128i x = _mm_loadu_si128((__m128i*)(p + i));
+        __m128i rb = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(x, 16), lo), _mm_slli_epi32(_mm_and_si128(x, lo), 16));
+        _mm_storeu_si128((__m128i*)(p + i), _mm_or_si128(_mm_and_si128(x, ag), rb));
+    }
+}
+
+__attribute__((target("sse2")))
+static void leanloader_premultiply_sse2(u32* p, u64 n) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i rgb = _mm_setr_epi16(-1, -1, -1, 0, -1, -1, -1, 0);
+    __m128i a255 = _mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255);
+    __m128i round = _mm_set1_epi16(128);
+    __m128i m257 = _mm_set1_epi16(257);
+    for (u64 i = 0; i < n; i += 4) {
+        __m128i x = _mm_loadu_si128((__m128i*)(p + i));
+        __m128i l = _mm_unpacklo_epi8(x, zero);
+        __m128i h = _mm_unpackhi_epi8(x, zero);
+        __m128i la = _mm_or_si128(_mm_and_si128(_mm_shufflehi_epi16(_mm_shufflelo_epi16(l, 0xff), 0xff), rgb), a255);
+        __m128i ha = _mm_or_si128(_mm_and_si128(_mm_shufflehi_epi16(_mm_shufflelo_epi16(h, 0xff), 0xff), rgb), a255);
+        l = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(l, la), round), m257);
+        h = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(h, ha), round), m257);
+        _mm_storeu_si128((__m128i*)(p + i), _mm_packus_epi16(l, h));
+    }
+}
+
+__attribute__((target("sse2")))
+static void leanloader_unpremultiply_sse2(u32* p, u64 n) {
+    __m128i lo = _mm_set1_epi32(0xff);
+    __m128i alpha = _mm_set1_epi32(0xff000000);
+    for (u64 i = 0; i < n; i += 4) {
+        __m128i x = _mm_loadu_si128((__m128i*)(p + i));
+        __m128i a = _mm_srli_epi32(x, 24);
+        __m128i half = _mm_srli_epi32(a, 1);
+        __m128 af = _mm_cvtepi32_ps(a);
+        __m128i out = _mm_and_si128(x, alpha);
+        for (u32 shift = 0; shift < 24; shift += 8) {
+            __m128i c = _mm_and_si128(_mm_srl_epi32(x, _mm_cvtsi32_si128(shift)), lo);
+            __m128i num = _mm_add_epi32(_mm_sub_epi32(_mm_slli_epi32(c, 8), c), half);
+            __m128i q = _mm_cvttps_epi32(_mm_div_ps(_mm_cvtepi32_ps(num), af));
+            __m128i over = _mm_cmpgt_epi32(q, lo);
+            q = _mm_or_si128(_mm_andnot_si128(over, q), _mm_and_si128(over, lo));
+            out = _mm_or_si128(out, _mm_sll_epi32(_mm_and_si128(q, lo), _mm_cvtsi32_si128(shift)));
+        }
+        out = _mm_andnot_si128(_mm_cmpeq_epi32(a, _mm_setzero_si128()), out);
+        _mm_storeu_si128((__m128i*)(p + i), out);
+    }
+}
+
+__attribute__((target("avx2")))
+static void leanloader_swizzle_avx2(u32* p, u64 n) {
+    __m256i shuffle = _mm256_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15,
+                                       2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+    for (u64 i = 0; i < n; i += 8) {
+        __m256i x = _mm256_loadu_si256((__m256i*)(p + i));
+        _mm256_storeu_si256((__m256i*)(p + i), _mm256_shuffle_epi8(x, shuffle));
+    }
+}
+
+__attribute__((target("avx2")))
+static void leanloader_premultiply_avx2(u32* p, u64 n) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i spread = _mm256_setr_epi8(6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1,
+                                      6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1);
+    __m256i a255 = _mm256_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255);
+    __m256i round = _mm256_set1_epi16(128);
+    __m256i m257 = _mm256_set1_epi16(257);
+    for (u64 i = 0; i < n; i += 8) {
+        __m256i x = _mm256_loadu_si256((__m256i*)(p + i));
+        __m256i l = _mm256_unpacklo_epi8(x, zero);
+        __m256i h = _mm256_unpackhi_epi8(x, zero);
+        __m256i la = _mm256_or_si256(_mm256_shuffle_epi8(l, spread), a255);
+        __m256i ha = _mm256_or_si256(_mm256_shuffle_epi8(h, spread), a255);
+        l = _mm256_mulhi_epu16(_mm256_add_epi16(_mm256_mullo_epi16(l, la), round), m257);
+        h = _mm256_mulhi_epu16(_mm256_add_epi16(_mm256_mullo_epi16(h, ha), round), m257);
+        _mm256_storeu_si256((__m256i*)(p + i), _mm256_packus_epi16(l, h));
+    }
+}
+
+__attribute__((target("avx2")))
+static void leanloader_unpremultiply_avx2(u32* p, u64 n) {
+    __m256i lo = _mm256_set1_epi32(0xff);
+    __m256i alpha = _mm256_set1_epi32(0xff000000);
+    for (u64 i = 0; i < n; i += 8) {
+        __m256i x = _mm256_loadu_si256((__m256i*)(p + i));
+        __m256i a = _mm256_srli_epi32(x, 24);
+        __m256i half = _mm256_srli_epi32(a, 1);
+        __m256 af = _mm256_cvtepi32_ps(a);
+        __m256i out = _mm256_and_si256(x, alpha);
+        for (u32 shift = 0; shift < 24; shift += 8) {
+            __m256i c = _mm256_and_si256(_mm256_srl_epi32(x, _mm_cvtsi32_si128(shift)), lo);
+            __m256i num = _mm256_add_epi32(_mm256_sub_epi32(_mm256_slli_epi32(c, 8), c), half);
+            __m256i q = _mm256_cvttps_epi32(_mm256_div_ps(_mm256_cvtepi32_ps(num), af));
+            // a == 0 gives 0x80000000 here, which the min leaves alone and the mask below clears
+            q = _mm256_min_epi32(q, lo);
+            out = _mm256_or_si256(out, _mm256_sll_epi32(_mm256_and_si256(q, lo), _mm_cvtsi32_si128(shift)));
+        }
+        out = _mm256_andnot_si256(_mm256_cmpeq_epi32(a, _mm256_setzero_si256()), out);
+        _mm256_storeu_si256((__m256i*)(p + i), out);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void leanloader_swizzle_avx512(u32* p, u64 n) {
+    __m512i shuffle = _mm512_broadcast_i32x4(_mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15));
+    for (u64 i = 0; i < n; i += 16) {
+        __m512i x = _mm512_loadu_si512((__m512i*)(p + i));
+        _mm512_storeu_si512((__m512i*)(p + i), _mm512_shuffle_epi8(x, shuffle));
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void leanloader_premultiply_avx512(u32* p, u64 n) {
+    __m512i zero = _mm512_setzero_si512();
+    __m512i spread = _mm512_broadcast_i32x4(_mm_setr_epi8(6, 7, 6, 7, 6, 7, -1, -1, 14, 15, 14, 15, 14, 15, -1, -1));
+    __m512i a255 = _mm512_broadcast_i32x4(_mm_setr_epi16(0, 0, 0, 255, 0, 0, 0, 255));
+    __m512i round = _mm512_set1_epi16(128);
+    __m512i m257 = _mm512_set1_epi16(257);
+    for (u64 i = 0; i < n; i += 16) {
+        __m512i x = _mm512_loadu_si512((__m512i*)(p + i));
+        __m512i l = _mm512_unpacklo_epi8(x, zero);
+        __m512i h = _mm512_unpackhi_epi8(x, zero);
+        __m512i la = _mm512_or_si512(_mm512_shuffle_epi8(l, spread), a255);
+        __m512i ha = _mm512_or_si512(_mm512_shuffle_epi8(h, spread), a255);
+        l = _mm512_mulhi_epu16(_mm512_add_epi16(_mm512_mullo_epi16(l, la), round), m257);
+        h = _mm512_mulhi_epu16(_mm512_add_epi16(_mm512_mullo_epi16(h, ha), round), m257);
+        _mm512_storeu_si512((__m512i*)(p + i), _mm512_packus_epi16(l, h));
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void leanloader_unpremultiply_avx512(u32* p, u64 n) {
+    __m512i lo = _mm512_set1_epi32(0xff);
+    __m512i alpha = _mm512_set1_epi32(0xff000000);
+    for (u64 i = 0; i < n; i += 16) {
+        __m512i x = _mm512_loadu_si512((__m512i*)(p + i));
+        __m512i a = _mm512_srli_epi32(x, 24);
+        __m512i half = _mm512_srli_epi32(a, 1);
+        __m512 af = _mm512_cvtepi32_ps(a);
+        __m512i out = _mm512_and_si512(x, alpha);
+        for (u32 shift = 0; shift < 24; shift += 8) {
+            __m512i c = _mm512_and_si512(_mm512_srl_epi32(x, _mm_cvtsi32_si128(shift)), lo);
+            __m512i num = _mm512_add_epi32(_mm512_sub_epi32(_mm512_slli_epi32(c, 8), c), half);
+            __m512i q = _mm512_min_epi32(_mm512_cvttps_epi32(_mm512_div_ps(_mm512_cvtepi32_ps(num), af)), lo);
+            out = _mm512_or_si512(out, _mm512_sll_epi32(_mm512_and_si512(q, lo), _mm_cvtsi32_si128(shift)));
+        }
+        out = _mm512_maskz_mov_epi32(_mm512_test_epi32_mask(a, a), out);
+        _mm512_storeu_si512((__m512i*)(p + i), out);
+    }
+}
+#else
+#define leanloader_swizzle_sse2             leanloader_swizzle_scalar
+#define leanloader_swizzle_avx2             leanloader_swizzle_scalar
+#define leanloader_swizzle_avx512           leanloader_swizzle_scalar
+#define leanloader_premultiply_sse2         leanloader_premultiply_scalar
+#define leanloader_premultiply_avx2         leanloader_premultiply_scalar
+#define leanloader_premultiply_avx512       leanloader_premultiply_scalar
+#define leanloader_unpremultiply_sse2       leanloader_unpremultiply_scalar
+#define leanloader_unpremultiply_avx2       leanloader_unpremultiply_scalar
+#define leanloader_unpremultiply_avx512     leanloader_unpremultiply_scalar
+#endif
+
+// indexed by LEANLOADER_CPU_*
+static leanloader_kernel_t leanloader_swizzle_kernels[4] = {
+    leanloader_swizzle_scalar, leanloader_swizzle_sse2, leanloader_swizzle_avx2, leanloader_swizzle_avx512};
+static leanloader_kernel_t leanloader_premultiply_kernels[4] = {
+    leanloader_premultiply_scalar, leanloader_premultiply_sse2, leanloader_premultiply_avx2, leanloader_premultiply_avx512};
+static leanloader_kernel_t leanloader_unpremultiply_kernels[4] = {
+    leanloader_unpremultiply_scalar, leanloader_unpremultiply_sse2, leanloader_unpremultiply_avx2, leanloader_unpremultiply_avx512};
+
+// runs a kernel over one level of the image (the image itself, or one of its mips). if the
+// rows are back to back in one of our buffers, that's a single pass over everything up to
+// the 64-byte padding at the end (the padding is zeroes, even in a view of a BMP, and all
+// of these leave zeroes alone). otherwise it goes row by row, with the scalar kernel doing whatever is left past
+// the last whole block of each. a caller's dst only has to hold the image up to its last
+// pixel, so it always goes row by row, mips included.
+static void leanloader_kernel_run(leanloader_image_info* info, u32 level, leanloader_kernel_t* kernels) {
+    leanloader_kernel_t simd = kernels[env.cpu];
+    leanloader_mip m = {0, 0, info->bd.w, info->bd.h, info->bd.stride};
+    if (level)
+        m = info->mip[level];
+    u8* p = (u8*)info->bd.ptr + m.offset;
+    u64 rowbytes = (u64)m.w * 4;
+    if (info->storage != LEANLOADER_STORAGE_CALLER && (u64)m.stride == rowbytes) {
+        simd((u32*)p, (rowbytes * m.h + 63 & ~(u64)63) / 4);
+        return;
+    }
+    u64 blocks = m.w & ~15u;
+    for (u32 y = 0; y < m.h; y++) {
+        u32* row = (u32*)(p + (u64)m.stride * y);
+        simd(row, blocks);
+        kernels[LEANLOADER_CPU_SCALAR](row + blocks, m.w - blocks);
+    }
+}
+
+// reverses the order of the rows of one level, a pair at a time through a scratch row
+static i32 leanloader_flip(leanloader_image_info* info, u32 level) {
+    u32 GMEM_FIXED = 0x0000;
+    leanloader_mip m = {0, 0, info->bd.w, info->bd.h, info->bd.stride};
+    if (level)
+        m = info->mip[level];
+    u64 rowbytes = (u64)m.w * 4;
+    u8* tmp = env.GlobalAlloc(GMEM_FIXED, rowbytes);
+    if (tmp == 0)
+        return 0;
+    u8* top = (u8*)info->bd.ptr + m.offset;
+    u8* bottom = top + (u64)m.stride * (m.h - 1);
+    for (; top < bottom; top += m.stride, bottom -= m.stride) {
+        leanloader_copy(tmp, top, rowbytes);
+        leanloader_copy(top, bottom, rowbytes);
+        leanloader_copy(bottom, tmp, rowbytes);
+    }
+    env.GlobalFree(tmp);
+    return 1;
+}
+
+// runs the LEANLOADER_CONVERT_* steps in ops over a loaded 32bpp image (and its mips, if it
+// has any), in place, in the order they're listed in. premultiplying and unpremultiplying
+// update bd.PixelFormat; the RGBA swizzle doesn't, as GDI+ has no name for the result.
+// images from the cache are read-only and refused. returns nonzero on success.
+i32 leanloader_convert(leanloader_image_info* info, u32 ops) {
+    static leanloader_kernel_t linearize[4] = {
+        leanloader_linearize_scalar, leanloader_linearize_scalar, leanloader_linearize_scalar, leanloader_linearize_scalar};
+    u32 format = info->bd.PixelFormat;
+    if (info->bd.ptr == 0 || (format != LEANLOADER_FORMAT_ARGB && format != LEANLOADER_FORMAT_PARGB))
+        return 0;
+    // cached pixels are shared with every other load of the same file
+    if (info->storage == LEANLOADER_STORAGE_CACHE)
+        return 0;
+    leanloader_kernel_init();
+    u32 levels = info->mips ? info->mips : 1;
+    for (u32 level = 0; level < levels; level++) {
+        if (ops & LEANLOADER_CONVERT_UNPREMULTIPLY)
+            leanloader_kernel_run(info, level, leanloader_unpremultiply_kernels);
+        if (ops & LEANLOADER_CONVERT_LINEAR)
+            leanloader_kernel_run(info, level, linearize);
+        if (ops & LEANLOADER_CONVERT_PREMULTIPLY)
+            leanloader_kernel_run(info, level, leanloader_premultiply_kernels);
+        if (ops & LEANLOADER_CONVERT_RGBA)
+            leanloader_kernel_run(info, level, leanloader_swizzle_kernels);
+        if ((ops & LEANLOADER_CONVERT_FLIP) && !leanloader_flip(info, level))
+            return 0;
+    }
+    if (ops & LEANLOADER_CONVERT_UNPREMULTIPLY)
+        info->bd.PixelFormat = LEANLOADER_FORMAT_ARGB;
+    if (ops & LEANLOADER_CONVERT_PREMULTIPLY)
+        info->bd.PixelFormat = LEANLOADER_FORMAT_PARGB;
+    return 1;
+}
+
+// block compression, for leanloader_compress. BC1 and BC3 color is the usual real-time
+// scheme: the corners of the color bounding box, pulled in by 1/16 of its size, as the
+// endpoints, and each pixel's index from where it projects onto the line between them.
+// BC7 only ever uses mode 6 (one subset, RGBA endpoints, 4-bit indices), with the
+// endpoints along the principal axis of the block's colors; slower, and a lot better.
+typedef void (*leanloader_bc_kernel_t)(u32* px, u8* out);
+
+static u32 leanloader_rgb565(u32 p) {
+    u32 r = ((p >> 16 & 0xff) * 31 + 127) / 255;
+    u32 g = ((p >> 8 & 0xff) * 63 + 127) / 255;
+    u32 b = ((p & 0xff) * 31 + 127) / 255;
+    return r << 11 | g << 5 | b;
+}
+
+// back to 8 bits a channel, the way the decoder sees it
+static u32 leanloader_rgb888(u32 c) {
+    u32 r = c >> 11, g = c >> 5 & 63, b = c & 31;
+    return (r << 3 | r >> 2) << 16 | (g << 2 | g >> 4) << 8 | (b << 3 | b >> 2);
+}
+
+// the endpoints for the corners lo and hi of a bounding box; c0 >= c1, as 4-color blocks need
+static void leanloader_bc_endpoints(u32 lo, u32 hi, u32* c0, u32* c1) {
+    u32 a = 0, b = 0;
+    for (u32 shift = 0; shift < 24; shift += 8) {
+        u32 l = lo >> shift & 0xff, h = hi >> shift & 0xff;
+        u32 inset = (h - l) >> 4;
+        a |= (h - inset) << shift;
+        b |= (l + inset) << shift;
+    }
+    *c0 = leanloader_rgb565(a);
+    *c1 = leanloader_rgb565(b);
+}
+
+static void leanloader_bc_write(u8* out, u32 c0, u32 c1, u32 indices) {
+    out[0] = (u8)c0;
+    out[1] = (u8)(c0 >> 8);
+    out[2] = (u8)c1;
+    out[3] = (u8)(c1 >> 8);
+    *(leanloader_i32u*)(out + 4) = (i32)indices;
+}
+
+// a 4-color block, alpha ignored. with e1 to e0 as the axis, t (0 at e1, d at e0) picks
+// e1, 2/3 e1 + 1/3 e0, 1/3 e1 + 2/3 e0 or e0, which are indices 1, 3, 2 and 0
+static void leanloader_bc_color_scalar(u32* px, u8* out) {
+    u32 lo = 0xffffff, hi = 0;
+    for (u32 i = 0; i < 16; i++) {
+        for (u32 shift = 0; shift < 24; shift += 8) {
+            u32 v = px[i] >> shift & 0xff;
+            if (v < (lo >> shift & 0xff))
+                lo = (lo & ~(0xffu << shift)) | v << shift;
+            if (v > (hi >> shift & 0xff))
+                hi = (hi & ~(0xffu << shift)) | v << shift;
+        }
+    }
+    u32 c0, c1;
+    leanloader_bc_endpoints(lo, hi, &c0, &c1);
+    if (c0 == c1) {
+        leanloader_bc_write(out, c0, c1, 0);
+        return;
+    }
+    u32 e0 = leanloader_rgb888(c0), e1 = leanloader_rgb888(c1);
+    i32 dir[3], d = 0;
+    for (u32 c = 0; c < 3; c++) {
+        dir[c] = (i32)(e0 >> 8 * c & 0xff) - (i32)(e1 >> 8 * c & 0xff);
+        d += dir[c] * dir[c];
+    }
+    u32 indices = 0;
+    for (u32 i = 0; i < 16; i++) {
+        i32 t = 0;
+        for (u32 c = 0; c < 3; c++)
+            t += ((i32)(px[i] >> 8 * c & 0xff) - (i32)(e1 >> 8 * c & 0xff)) * dir[c];
+        u32 bit1 = t * 6 >= d && t * 6 < 5 * d;
+        u32 bit0 = t * 2 < d;
+        indices |= (bit1 << 1 | bit0) << 2 * i;
+    }
+    leanloader_bc_write(out, c0, c1, indices);
+}
+
+// spreads the low 16 bits of x out to the even bits
+static u32 leanloader_spread16(u32 x) {
+    x = (x | x << 8) & 0x00ff00ff;
+    x = (x | x << 4) & 0x0f0f0f0f;
+    x = (x | x << 2) & 0x33333333;
+    return (x | x << 1) & 0x55555555;
+}
+
+#if defined(__SSE2__)
+// same as the scalar one, bit for bit: the bounding box from min/max over the four rows,
+// the projections with madd, and the two index bits of all 16 pixels from two movemasks
+__attribute__((target("sse2")))
+static void leanloader_bc_color_sse2(u32* px, u8* out) {
+    __m128i r[4];
+    for (u32 i = 0; i < 4; i++)
+        r[i] = _mm_loadu_si128((__m128i*)(px + 4 * i));
+    __m128i mn = _mm_min_epu8(_mm_min_epu8(r[0], r[1]), _mm_min_epu8(r[2], r[3]));
+    __m128i mx = _mm_max_epu8(_mm_max_epu8(r[0], r[1]), _mm_max_epu8(r[2], r[3]));
+    mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, 0x4e));
+    mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, 0x4e));
+    mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, 0xb1));
+    mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, 0xb1));
+    u32 c0, c1;
+    leanloader_bc_endpoints((u32)_mm_cvtsi128_si32(mn) & 0xffffff, (u32)_mm_cvtsi128_si32(mx) & 0xffffff, &c0, &c1);
+    if (c0 == c1) {
+        leanloader_bc_write(out, c0, c1, 0);
+        return;
+    }
+    u32 e0 = leanloader_rgb888(c0), e1 = leanloader_rgb888(c1);
+    i32 db = (i32)(e0 & 0xff) - (i32)(e1 & 0xff);
+    i32 dg = (i32)(e0 >> 8 & 0xff) - (i32)(e1 >> 8 & 0xff);
+    i32 dr = (i32)(e0 >> 16 & 0xff) - (i32)(e1 >> 16 & 0xff);
+    i32 d = db * db + dg * dg + dr * dr;
+    __m128i zero = _mm_setzero_si128();
+    __m128i dir = _mm_set_epi16(0, (short)dr, (short)dg, (short)db, 0, (short)dr, (short)dg, (short)db);
+    __m128i base = _mm_unpacklo_epi8(_mm_cvtsi32_si128((i32)e1), zero);
+    base = _mm_unpacklo_epi64(base, base);
+    __m128i d1 = _mm_set1_epi32(d - 1), d5 = _mm_set1_epi32(5 * d - 1);
+    __m128i bit1[4], bit0[4];
+    for (u32 i = 0; i < 4; i++) {
+        __m128i lo = _mm_madd_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(r[i], zero), base), dir);
+        __m128i hi = _mm_madd_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(r[i], zero), base), dir);
+        __m128i t = _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), 0x88)),
+                                  _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), 0xdd)));
+        __m128i t2 = _mm_add_epi32(t, t);
+        __m128i t6 = _mm_add_epi32(t2, _mm_add_epi32(t2, t2));
+        bit1[i] = _mm_andnot_si128(_mm_cmpgt_epi32(t6, d5), _mm_cmpgt_epi32(t6, d1));
+        bit0[i] = _mm_cmplt_epi32(t2, _mm_set1_epi32(d));
+    }
+    u32 m1 = (u32)_mm_movemask_epi8(_mm_packs_epi16(_mm_packs_epi32(bit1[0], bit1[1]), _mm_packs_epi32(bit1[2], bit1[3])));
+    u32 m0 = (u32)_mm_movemask_epi8(_mm_packs_epi16(_mm_packs_epi32(bit0[0], bit0[1]), _mm_packs_epi32(bit0[2], bit0[3])));
+    leanloader_bc_write(out, c0, c1, leanloader_spread16(m1) << 1 | leanloader_spread16(m0));
+}
+#else
+#define leanloader_bc_color_sse2    leanloader_bc_color_scalar
+#endif
+
+// indexed by LEANLOADER_CPU_*; a block is four SSE registers, wider ones would just sit half empty
+static leanloader_bc_kernel_t leanloader_bc_color_kernels[4] = {
+    leanloader_bc_color_scalar, leanloader_bc_color_sse2, leanloader_bc_color_sse2, leanloader_bc_color_sse2};
+
+// BC1 with transparent pixels: a 3-color block (c0 <= c1) over the opaque ones, index 3 for the rest
+static void leanloader_bc1_punchthrough(u32* px, u8* out) {
+    u32 lo = 0xffffff, hi = 0;
+    for (u32 i = 0; i < 16; i++) {
+        if (px[i] >> 24 < 128)
+            continue;
+        for (u32 shift = 0; shift < 24; shift += 8) {
+            u32 v = px[i] >> shift & 0xff;
+            if (v < (lo >> shift & 0xff))
+                lo = (lo & ~(0xffu << shift)) | v << shift;
+            if (v > (hi >> shift & 0xff))
+                hi = (hi & ~(0xffu << shift)) | v << shift;
+        }
+    }
+    // with no opaque pixels at all, the box is still inside out and the block is all index 3
+    u32 c0 = 0, c1 = 0;
+    if (hi >= lo)
+        leanloader_bc_endpoints(lo, hi, &c1, &c0);
+    u32 e0 = leanloader_rgb888(c0), e1 = leanloader_rgb888(c1);
+    i32 dir[3], d = 0;
+    for (u32 c = 0; c < 3; c++) {
+        dir[c] = (i32)(e1 >> 8 * c & 0xff) - (i32)(e0 >> 8 * c & 0xff);
+        d += dir[c] * dir[c];
+    }
+    u32 indices = 0;
+    for (u32 i = 0; i < 16; i++) {
+        u32 index = 3;
+        if (px[i] >> 24 >= 128) {
+            i32 t = 0;
+            for (u32 c = 0; c < 3; c++)
+                t += ((i32)(px[i] >> 8 * c & 0xff) - (i32)(e0 >> 8 * c & 0xff)) * dir[c];
+            index = t * 4 < d ? 0 : t * 4 < 3 * d ? 2 : 1;
+        }
+        indices |= index << 2 * i;
+    }
+    leanloader_bc_write(out, c0, c1, indices);
+}
+
+static void leanloader_bc1_block(u32* px, u8* out) {
+    u32 all = 0xff;
+    for (u32 i = 0; i < 16; i++)
+        all &= px[i] >> 24 >= 128;
+    if (all)
+        leanloader_bc_color_kernels[env.cpu](px, out);
+    else
+        leanloader_bc1_punchthrough(px, out);
+}
+
+// the alpha half of BC3: the 8-value mode between the lowest and highest alpha. a level k
+// of 7 up from the lowest is index 1 for k = 0, 0 for k = 7, and 8 - k in between.
+static void leanloader_bc3_block(u32* px, u8* out) {
+    u32 lo = 255, hi = 0;
+    for (u32 i = 0; i < 16; i++) {
+        u32 a = px[i] >> 24;
+        lo = a < lo ? a : lo;
+        hi = a > hi ? a : hi;
+    }
+    u64 indices = 0;
+    if (hi > lo) {
+        for (u32 i = 0; i < 16; i++) {
+            u32 k = ((px[i] >> 24) - lo) * 14 + (hi - lo);
+            k /= 2 * (hi - lo);
+            u64 index = k == 0 ? 1 : k == 7 ? 0 : 8 - k;
+            indices |= index << 3 * i;
+        }
+    }
+    out[0] = (u8)hi;
+    out[1] = (u8)lo;
+    for (u32 i = 0; i < 6; i++)
+        out[2 + i] = (u8)(indices >> 8 * i);
+    leanloader_bc_color_kernels[env.cpu](px, out + 8);
+}
+
+// rounds a channel to 7 bits plus the p-bit, 0..255
+static u32 leanloader_bc7_quantize(float v, u32 p) {
+    i32 q = (i32)((v - (float)p) * 0.5f + 0.5f);
+    q = q < 0 ? 0 : q > 127 ? 127 : q;
+    return (u32)q;
+}
+
+// BC7 mode 6. the principal axis comes from a few rounds of power iteration on the
+// covariance, and the endpoints are where the pixels' projections onto it are furthest
+// apart, each rounded to 7 bits per channel with whichever p-bit comes out closer.
+static void leanloader_bc7_block(u32* px, u8* out) {
+    static u8 weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+    float p[16][4], mean[4] = {0, 0, 0, 0};
+    for (u32 i = 0; i < 16; i++) {
+        // R G B A, the order the block stores them in
+        p[i][0] = (float)(px[i] >> 16 & 0xff);
+        p[i][1] = (float)(px[i] >> 8 & 0xff);
+        p[i][2] = (float)(px[i] & 0xff);
+        p[i][3] = (float)(px[i] >> 24);
+        for (u32 c = 0; c < 4; c++)
+            mean[c] += p[i][c] * (1.0f / 16);
+    }
+    float cov[4][4] = {{0}};
+    for (u32 i = 0; i < 16; i++)
+        for (u32 a = 0; a < 4; a++)
+            for (u32 b = 0; b < 4; b++)
+                cov[a][b] += (p[i][a] - mean[a]) * (p[i][b] - mean[b]);
+    // starting from the channel that varies most, so the first round can't come out zero
+    u32 widest = 0;
+    for (u32 c = 1; c < 4; c++)
+        widest = cov[c][c] > cov[widest][widest] ? c : widest;
+    float axis[4] = {cov[widest][0], cov[widest][1], cov[widest][2], cov[widest][3]};
+    for (u32 round = 0; round < 8; round++) {
+        float next[4] = {0, 0, 0, 0}, big = 0;
+        for (u32 a = 0; a < 4; a++) {
+            for (u32 b = 0; b < 4; b++)
+                next[a] += cov[a][b] * axis[b];
+            float m = next[a] < 0 ? -next[a] : next[a];
+            big = m > big ? m : big;
+        }
+        if (big < 1e-6f)
+            break;
+        for (u32 a = 0; a < 4; a++)
+            axis[a] = next[a] / big;
+    }
+    float len = 0, tmin = 0, tmax = 0;
+    for (u32 c = 0; c < 4; c++)
+        len += axis[c] * axis[c];
+    for (u32 i = 0; i < 16; i++) {
+        float t = 0;
+        for (u32 c = 0; c < 4; c++)
+            t += (p[i][c] - mean[c]) * axis[c];
+        tmin = t < tmin ? t : tmin;
+        tmax = t > tmax ? t : tmax;
+    }
+    u32 q[2][4], pbit[2], e[2][4];
+    for (u32 n = 0; n < 2; n++) {
+        float t = (n ? tmax : tmin) / (len > 0 ? len : 1);
+        float v[4];
+        for (u32 c = 0; c < 4; c++) {
+            v[c] = mean[c] + t * axis[c];
+            v[c] = v[c] < 0 ? 0 : v[c] > 255 ? 255 : v[c];
+        }
+        // only the odd p-bit reaches 255, which opaque blocks have to stay at
+        float best = -1;
+        for (u32 b = v[3] >= 255; b < 2; b++) {
+            float err = 0;
+            u32 qq[4];
+            for (u32 c = 0; c < 4; c++) {
+                qq[c] = leanloader_bc7_quantize(v[c], b);
+                float diff = (float)(qq[c] << 1 | b) - v[c];
+                err += diff * diff;
+            }
+            if (best < 0 || err < best) {
+                best = err;
+                pbit[n] = b;
+                for (u32 c = 0; c < 4; c++)
+                    q[n][c] = qq[c];
+            }
+        }
+        for (u32 c = 0; c < 4; c++)
+            e[n][c] = q[n][c] << 1 | pbit[n];
+    }
+    i32 dir[4], dd = 0;
+    for (u32 c = 0; c < 4; c++) {
+        dir[c] = (i32)e[1][c] - (i32)e[0][c];
+        dd += dir[c] * dir[c];
+    }
+    u32 index[16];
+    for (u32 i = 0; i < 16; i++) {
+        i32 t = 0;
+        for (u32 c = 0; c < 4; c++)
+            t += ((i32)p[i][c] - (i32)e[0][c]) * dir[c];
+        // the weights are nearly even, so the nearest one is next to t * 15 / dd
+        i32 k = dd ? (t * 15 + dd / 2) / dd : 0;
+        k = k < 0 ? 0 : k > 15 ? 15 : k;
+        i32 best = k;
+        for (i32 j = k - 1; j <= k + 1; j++) {
+            if (j < 0 || j > 15)
+                continue;
+            i32 a = weights[j] * dd - 64 * t, b = weights[best] * dd - 64 * t;
+            if ((a < 0 ? -a : a) < (b < 0 ? -b : b))
+                best = j;
+        }
+        index[i] = (u32)best;
+    }
+    // the first index is stored without its top bit, so it has to be under 8
+    u32 swap = index[0] >= 8;
+    u64 lo = 1 << 6, hi = 0;
+    u32 pos = 7;
+    #define LEANLOADER_BC7_PUT(v, n) do { u64 v_ = (u64)(v); \
+        if (pos < 64) { lo |= v_ << pos; if (pos + (n) > 64) hi |= v_ >> (64 - pos); } \
+        else { hi |= v_ << (pos - 64); } \
+        pos += (n); } while (0)
+    for (u32 c = 0; c < 4; c++) {
+        LEANLOADER_BC7_PUT(q[swap][c], 7);
+        LEANLOADER_BC7_PUT(q[!swap][c], 7);
+    }
+    LEANLOADER_BC7_PUT(pbit[swap], 1);
+    LEANLOADER_BC7_PUT(pbit[!swap], 1);
+    for (u32 i = 0; i < 16; i++) {
+        u32 k = swap ? 15 - index[i] : index[i];
+        LEANLOADER_BC7_PUT(k, i ? 4 : 3);
+    }
+    #undef LEANLOADER_BC7_PUT
+    for (u32 i = 0; i < 8; i++) {
+        out[i] = (u8)(lo >> 8 * i);
+        out[8 + i] = (u8)(hi >> 8 * i);
+    }
+}
+
+// compresses one w x h level, block row by block row. the blocks on the right and bottom
+// edges repeat the last column and row to fill themselves out.
+static void leanloader_bc_level(u8* src, i32 srcstride, u32 w, u32 h, u8* dst, i32 dststride, u32 format) {
+    u32 blockbytes = leanloader_format_block(format);
+    u32 px[16];
+    for (u32 by = 0; by < h; by += 4) {
+        u8* out = dst + (u64)dststride * (by / 4);
+        for (u32 bx = 0; bx < w; bx += 4) {
+            for (u32 y = 0; y < 4; y++) {
+                u32* row = (u32*)(src + (u64)srcstride * (by + y < h ? by + y : h - 1));
+                for (u32 x = 0; x < 4; x++)
+                    px[4 * y + x] = row[bx + x < w ? bx + x : w - 1];
+            }
+            if (format == LEANLOADER_FORMAT_BC1)
+                leanloader_bc1_block(px, out);
+            else if (format == LEANLOADER_FORMAT_BC3)
+                leanloader_bc3_block(px, out);
+            else
+                leanloader_bc7_block(px, out);
+            out += blockbytes;
+        }
+    }
+}
+
+// replaces the pixels of a loaded 32bpp image (and its mips) with their BC1, BC3 or BC7
+// (LEANLOADER_FORMAT_BC*) compressed blocks, in a new buffer the size of those, or in dst
+// if one was given, with dststride as its row pitch. a GDI+ bitmap still kept around is
+// let go of. setting the format field to one of these does the same as part of the load.
+// returns nonzero on success; on failure the image is left as it was.
+i32 leanloader_compress(leanloader_image_info* info, u32 format) {
+    u32 GMEM_FIXED = 0x0000;
+    u32 blockbytes = leanloader_format_block(format);
+    u32 source = info->bd.PixelFormat;
+    if (info->bd.ptr == 0 || blockbytes == 0 || (source != LEANLOADER_FORMAT_ARGB && source != LEANLOADER_FORMAT_PARGB)) {
+        info->error = LEANLOADER_ERROR_UNSUPPORTED;
+        return 0;
+    }
+    leanloader_kernel_init();
+    leanloader_image_info old = *info;
+    u32 levels = info->mips ? info->mips : 1;
+    leanloader_mip mip[LEANLOADER_MAX_MIPS];
+    u64 size = 0;
+    for (u32 level = 0; level < levels; level++) {
+        u32 w = level ? info->mip[level].w : info->bd.w;
+        u32 h = level ? info->mip[level].h : info->bd.h;
+        u64 rowbytes = (u64)(w + 3) / 4 * blockbytes;
+        u64 stride = level == 0 && info->dst && info->dststride ? (u64)info->dststride : rowbytes;
+        if (rowbytes > 0x7fffffff || stride < rowbytes || stride > 0x7fffffff) {
+            info->error = stride < rowbytes ? LEANLOADER_ERROR_DST : LEANLOADER_ERROR_TOO_BIG;
+            return 0;
+        }
+        mip[level].offset = size + 63 & ~(u64)63;
+        mip[level].size = stride * ((h + 3) / 4 - 1) + rowbytes;
+        mip[level].w = w;
+        mip[level].h = h;
+        mip[level].stride = (i32)stride;
+        size = mip[level].offset + mip[level].size;
+    }
+    if (info->dst && size > info->dstsize) {
+        info->error = LEANLOADER_ERROR_DST;
+        return 0;
+    }
+    // the blocks go over the caller's buffer, so the pixels move out of the way first
+    if (info->storage == LEANLOADER_STORAGE_CALLER) {
+        u64 bytes = leanloader_image_bytes(info);
+        old.bd.ptr = env.GlobalAlloc(GMEM_FIXED, bytes);
+        if (old.bd.ptr == 0) {
+            info->error = LEANLOADER_ERROR_MEMORY;
+            return 0;
+        }
+        leanloader_copy(old.bd.ptr, info->bd.ptr, bytes);
+        old.storage = LEANLOADER_STORAGE_GLOBAL;
+    }
+    if (info->dst) {
+        info->bd.ptr = info->dst;
+        info->storage = LEANLOADER_STORAGE_CALLER;
+    } else if (!leanloader_alloc_buffer(info, size)) {
+        *info = old;
+        info->error = LEANLOADER_ERROR_MEMORY;
+        return 0;
+    }
+    for (u32 level = 0; level < levels; level++) {
+        leanloader_mip m = {0, 0, old.bd.w, old.bd.h, old.bd.stride};
+        if (level)
+            m = old.mip[level];
+        leanloader_bc_level((u8*)old.bd.ptr + m.offset, m.stride, m.w, m.h,
+                            (u8*)info->bd.ptr + mip[level].offset, mip[level].stride, format);
+    }
+    if (old.gpbitmap) {
+        env.GdipBitmapUnlockBits(old.gpbitmap, &old.bd);
+        env.GdipDisposeImage(old.gpbitmap);
+        info->gpbitmap = 0;
+    }
+    leanloader_free_pixels(&old);
+    info->bd.PixelFormat = format;
+    info->bd.stride = mip[0].stride;
+    if (info->mips)
+        leanloader_copy(info->mip, mip, (u64)levels * sizeof(leanloader_mip));
+    return 1;
+}
+
+// loads just the w x h rectangle at x, y (clipped to the image). on success the struct
+// describes the region as if it were the whole image; there's never a GDI+ bitmap kept
+// around, so LEANLOADER_DETACHED is implied. dispose of it as usual.
+i32 leanloader_load_rect(leanloader_image_info* info, u32 x, u32 y, u32 w, u32 h) {
+    leanloader_reset(info);
+    leanloader_source src;
+    if (!leanloader_source_open(&src, info, 1))
+        return 0;
+    i32 loaded = 0;
+    if (x >= src.w || y >= src.h || w == 0 || h == 0) {
+        // none of the image in it
+        info->error = LEANLOADER_ERROR_UNSUPPORTED;
+    } else {
+        if (w > src.w - x)
+            w = src.w - x;
+        if (h > src.h - y)
+            h = src.h - y;
+        if (leanloader_alloc_pixels(info, w, h)) {
+            info->bd.w = w;
+            info->bd.h = h;
+            loaded = leanloader_source_read(&src, x, y, w, h, info->bd.ptr, info->bd.stride);
+            if (loaded) {
+                leanloader_mips_build(info);
+            } else {
+                info->error = leanloader_source_error(&src);
+                leanloader_free_pixels(info);
+            }
+        }
+    }
+    leanloader_source_close(&src);
+    return loaded;
+}
+
+// walks an image tile by tile, see leanloader_tiles_open
+typedef struct {
+    leanloader_image_info* info;
+    u32 tilew;
+    u32 tileh;
+    u32 x;              // position of the tile currently in info->bd
+    u32 y;
+    u32 w;              // size of the whole image
+    u32 h;
+    u32 started;
+    leanloader_source src;
+} leanloader_tiles;
+
+// opens the image named in info for reading in tilew x tileh tiles, left to right and top
+// to bottom. each leanloader_tiles_next puts the next tile in info->bd, always in the same
+// buffer (info->dst, if set), so only one tile's worth of pixels is ever allocated. tiles
+// along the right and bottom edges may be smaller; bd.stride stays the same.
+i32 leanloader_tiles_open(leanloader_tiles* tiles, leanloader_image_info* info, u32 tilew, u32 tileh) {
+    leanloader_reset(info);
+    // a mip chain per tile isn't something anyone wants
+    if (tilew == 0 || tileh == 0 || (info->flags & (LEANLOADER_MIPMAPS | LEANLOADER_MIPMAPS_SRGB))) {
+        info->error = LEANLOADER_ERROR_UNSUPPORTED;
+        return 0;
+    }
+    if (!leanloader_source_open(&tiles->src, info, tileh))
+        return 0;
+    tiles->info     = info;
+    tiles->w        = tiles->src.w;
+    tiles->h        = tiles->src.h;
+    tiles->tilew    = tilew < tiles->w ? tilew : tiles->w;
+    tiles->tileh    = tileh < tiles->h ? tileh : tiles->h;
+    tiles->x        = 0;
+    tiles->y        = 0;
+    tiles->started  = 0;
+    if (leanloader_alloc_pixels(info, tiles->tilew, tiles->tileh))
+        return 1;
+    leanloader_source_close(&tiles->src);
+    return 0;
+}
+
+// moves on to the next tile; tiles->x and tiles->y say where it is in the image. returns 0
+// once there are no more tiles, or if one couldn't be read.
+i32 leanloader_tiles_next(leanloader_tiles* tiles) {
+    if (tiles->started) {
+        tiles->x += tiles->tilew;
+        if (tiles->x >= tiles->w) {
+            tiles->x = 0;
+            tiles->y += tiles->tileh;
+        }
+    }
+    tiles->started = 1;
+    if (tiles->y >= tiles->h)
+        return 0;
+    leanloader_image_info* info = tiles->info;
+    info->bd.w = tiles->w - tiles->x < tiles->tilew ? tiles->w - tiles->x : tiles->tilew;
+    info->bd.h = tiles->h - tiles->y < tiles->tileh ? tiles->h - tiles->y : tiles->tileh;
+    if (leanloader_source_read(&tiles->src, tiles->x, tiles->y, info->bd.w, info->bd.h, info->bd.ptr, info->bd.stride))
+        return 1;
+    info->error = leanloader_source_error(&tiles->src);
+    return 0;
+}
+
+// closes the image and frees the tile buffer
+i32 leanloader_tiles_close(leanloader_tiles* tiles) {
+    leanloader_source_close(&tiles->src);
+    leanloader_free_pixels(tiles->info);
+    return 0;
+}
+
+// called by leanloader_load_rows for every band, which is in info->bd. height is that of
+// the whole image. return 0 to stop there.
+typedef i32 (*leanloader_rows_t)(leanloader_image_info* info, u32 y, u32 height, ptr userdata);
+
+// decodes the image named in info from the top down, bandrows rows at a time, and hands
+// each band to callback as it's done. like the tiles, every band goes into the same buffer
+// (info->dst, if set), so only a band's worth of pixels is ever allocated, and the native
+// decoders never hold more than a row of their own; GDI+ still decodes the whole image
+// internally. the last band may be shorter. no mips. the band buffer is gone by the time
+// this returns; it returns nonzero if every row was delivered.
+i32 leanloader_load_rows(leanloader_image_info* info, u32 bandrows, leanloader_rows_t callback, ptr userdata) {
+    leanloader_reset(info);
+    if (bandrows == 0 || (info->flags & (LEANLOADER_MIPMAPS | LEANLOADER_MIPMAPS_SRGB))) {
+        info->error = LEANLOADER_ERROR_UNSUPPORTED;
+        return 0;
+    }
+    leanloader_source src;
+    if (!leanloader_source_open(&src, info, 1))
+        return 0;
+    if (bandrows > src.h)
+        bandrows = src.h;
+    i32 loaded = 0;
+    if (leanloader_alloc_pixels(info, src.w, bandrows)) {
+        info->bd.w = src.w;
+        u32 y = 0;
+        while (y < src.h) {
+            info->bd.h = src.h - y < bandrows ? src.h - y : bandrows;
+            if (!leanloader_source_read(&src, 0, y, src.w, info->bd.h, info->bd.ptr, info->bd.stride)) {
+                info->error = leanloader_source_error(&src);
+                break;
+            }
+            if (!callback(info, y, src.h, userdata))
+                break;
+            y += info->bd.h;
+        }
+        loaded = y == src.h;
+        leanloader_free_pixels(info);
+    }
+    leanloader_source_close(&src);
+    return loaded;
+}
+
+// resampling filters for leanloader_load_scaled
+#define LEANLOADER_FILTER_BOX       0   // plain averaging, the fastest
+#define LEANLOADER_FILTER_BILINEAR  1   // a triangle, two pixels wide at the target scale
+#define LEANLOADER_FILTER_LANCZOS3  2   // windowed sinc, the sharpest
+
+// sin(pi * x), for the lanczos weights. no CRT, so it's a Taylor series after folding x
+// into [-0.5, 0.5]; good to about 1e-7, which is plenty for a filter kernel.
+static double leanloader_sinpi(double x) {
+    double half = x / 2;
+    x -= 2 * (double)(i64)(half + (half >= 0 ? 0.5 : -0.5));
+    if (x > 0.5)
+        x = 1 - x;
+    else if (x < -0.5)
+        x = -1 - x;
+    double t = 3.14159265358979323846 * x;
+    double t2 = t * t;
+    return t * (1 - t2 / 6 * (1 - t2 / 20 * (1 - t2 / 42 * (1 - t2 / 72 * (1 - t2 / 110)))));
+}
+
+static double leanloader_filter(u32 filter, double x) {
+    if (x < 0)
+        x = -x;
+    if (filter == LEANLOADER_FILTER_BOX)
+        return x <= 0.5 ? 1 : 0;
+    if (filter == LEANLOADER_FILTER_BILINEAR)
+        return x < 1 ? 1 - x : 0;
+    if (x >= 3)
+        return 0;
+    if (x < 1e-8)
+        return 1;
+    double pix = 3.14159265358979323846 * x;
+    return leanloader_sinpi(x) * leanloader_sinpi(x / 3) * 3 / (pix * pix);
+}
+
+static double leanloader_filter_radius(u32 filter) {
+    return filter == LEANLOADER_FILTER_BOX ? 0.5 : filter == LEANLOADER_FILTER_BILINEAR ? 1 : 3;
+}
+
+// which source pixels (start, and up to taps of them) each of n target pixels is made of,
+// and with what weights, for one axis
+typedef struct {
+    u32* start;
+    u32* count;
+    float* weight;      // taps per target pixel, the unused ones zero
+    u32 taps;
+} leanloader_contrib;
+
+static i32 leanloader_contrib_init(leanloader_contrib* c, u32 filter, u32 srcn, u32 n) {
+    u32 GPTR = 0x0040;
+    double scale = (double)srcn / n;
+    double filterscale = scale > 1 ? scale : 1;
+    double support = leanloader_filter_radius(filter) * filterscale;
+    c->taps = (u32)support * 2 + 3;
+    c->start = env.GlobalAlloc(GPTR, (u64)n * (8 + c->taps * sizeof(float)));
+    if (!c->start)
+        return 0;
+    c->count = c->start + n;
+    c->weight = (float*)(c->count + n);
+    for (u32 i = 0; i < n; i++) {
+        double center = (i + 0.5) * scale;
+        double lo = center - support + 0.5;
+        double hi = center + support + 0.5;
+        u32 first = lo > 0 ? (u32)lo : 0;
+        u32 end = hi < srcn ? (u32)hi : srcn;
+        if (end > first + c->taps)
+            end = first + c->taps;
+        if (end <= first)
+            end = first + 1;
+        float* w = c->weight + (u64)i * c->taps;
+        double sum = 0;
+        for (u32 k = first; k < end; k++)
+            sum += leanloader_filter(filter, (k + 0.5 - center) / filterscale);
+        for (u32 k = first; k < end; k++)
+            w[k - first] = sum != 0 ? (float)(leanloader_filter(filter, (k + 0.5 - center) / filterscale) / sum) : 1.0f / (end - first);
+        c->start[i] = first;
+        c->count[i] = end - first;
+    }
+    return 1;
+}
+
+// the resampler's kernels. rows of pixels go through it as 4 floats each, B G R A, with the
+// colors premultiplied, so transparent pixels don't bleed their color into their neighbours.
+typedef void (*leanloader_expand_kernel_t)(float* out, u32* in, u32 n);
+typedef void (*leanloader_hpass_kernel_t)(float* out, float* in, leanloader_contrib* c, u32 n);
+typedef void (*leanloader_vpass_kernel_t)(float* out, float** rows, float* w, u32 taps, u32 x, u32 n);
+
+static void leanloader_expand_scalar(float* out, u32* in, u32 n) {
+    for (u32 i = 0; i < n; i++) {
+        u32 p = in[i];
+        float a = (float)(p >> 24);
+        float f = a * (1.0f / 255);
+        out[i * 4]     = (float)(p & 0xff) * f;
+        out[i * 4 + 1] = (float)(p >> 8 & 0xff) * f;
+        out[i * 4 + 2] = (float)(p >> 16 & 0xff) * f;
+        out[i * 4 + 3] = a;
+    }
+}
+
+static void leanloader_hpass_scalar(float* out, float* in, leanloader_contrib* c, u32 n) {
+    for (u32 i = 0; i < n; i++) {
+        float* w = c->weight + (u64)i * c->taps;
+        float* p = in + (u64)c->start[i] * 4;
+        float b = 0, g = 0, r = 0, a = 0;
+        for (u32 k = 0; k < c->count[i]; k++) {
+            b += w[k] * p[k * 4];
+            g += w[k] * p[k * 4 + 1];
+            r += w[k] * p[k * 4 + 2];
+            a += w[k] * p[k * 4 + 3];
+        }
+        out[i * 4] = b;
+        out[i * 4 + 1] = g;
+        out[i * 4 + 2] = r;
+        out[i * 4 + 3] = a;
+    }
+}
+
+// x and n here count floats; the SIMD versions leave what's left over from x on to these
+static void leanloader_vpass_scalar(float* out, float** rows, float* w, u32 taps, u32 x, u32 n) {
+    for (; x < n; x++) {
+        float v = 0;
+        for (u32 k = 0; k < taps; k++)
+            v += w[k] * rows[k][x];
+        out[x] = v;
+    }
+}
+
+#if defined(__SSE2__)
+__attribute__((target("sse2")))
+static void leanloader_expand_sse2(float* out, u32* in, u32 n) {
+    __m128i zero = _mm_setzero_si128();
+    __m128 keep = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+    __m128 alpha = _mm_set_ps(1, 0, 0, 0);
+    for (u32 i = 0; i < n; i++) {
+        __m128i p = _mm_cvtsi32_si128((i32)in[i]);
+        __m128 v = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(p, zero), zero));
+        __m128 f = _mm_mul_ps(_mm_shuffle_ps(v, v, 0xff), _mm_set1_ps(1.0f / 255));
+        _mm_storeu_ps(out + i * 4, _mm_mul_ps(v, _mm_or_ps(_mm_and_ps(f, keep), alpha)));
+    }
+}
+
+__attribute__((target("sse2")))
+static void leanloader_hpass_sse2(float* out, float* in, leanloader_contrib* c, u32 n) {
+    for (u32 i = 0; i < n; i++) {
+        float* w = c->weight + (u64)i * c->taps;
+        float* p = in + (u64)c->start[i] * 4;
+        __m128 acc = _mm_setzero_ps();
+        for (u32 k = 0; k < c->count[i]; k++)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(p + k * 4)));
+        _mm_storeu_ps(out + i * 4, acc);
+    }
+}
+
+__attribute__((target("sse2")))
+static void leanloader_vpass_sse2(float* out, float** rows, float* w, u32 taps, u32 x, u32 n) {
+    for (; x + 4 <= n; x += 4) {
+        __m128 acc = _mm_setzero_ps();
+        for (u32 k = 0; k < taps; k++)
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(w[k]), _mm_loadu_ps(rows[k] + x)));
+        _mm_storeu_ps(out + x, acc);
+    }
+    leanloader_vpass_scalar(out, rows, w, taps, x, n);
+}
+
+// two pixels at a time on the expensive axis
+__attribute__((target("avx2")))
+static void leanloader_vpass_avx2(float* out, float** rows, float* w, u32 taps, u32 x, u32 n) {
+    for (; x + 16 <= n; x += 16) {
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        for (u32 k = 0; k < taps; k++) {
+            __m256 wk = _mm256_set1_ps(w[k]);
+            acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(wk, _mm256_loadu_ps(rows[k] + x)));
+            acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(wk, _mm256_loadu_ps(rows[k] + x + 8)));
+        }
+        _mm256_storeu_ps(out + x, acc0);
+        _mm256_storeu_ps(out + x + 8, acc1);
+    }
+    leanloader_vpass_sse2(out, rows, w, taps, x, n);
+}
+#else
+#define leanloader_expand_sse2      leanloader_expand_scalar
+#define leanloader_hpass_sse2       leanloader_hpass_scalar
+#define leanloader_vpass_sse2       leanloader_vpass_scalar
+#define leanloader_vpass_avx2       leanloader_vpass_scalar
+#endif
+
+// indexed by LEANLOADER_CPU_*
+static leanloader_expand_kernel_t leanloader_expand_kernels[4] = {
+    leanloader_expand_scalar, leanloader_expand_sse2, leanloader_expand_sse2, leanloader_expand_sse2};
+static leanloader_hpass_kernel_t leanloader_hpass_kernels[4] = {
+    leanloader_hpass_scalar, leanloader_hpass_sse2, leanloader_hpass_sse2, leanloader_hpass_sse2};
+static leanloader_vpass_kernel_t leanloader_vpass_kernels[4] = {
+    leanloader_vpass_scalar, leanloader_vpass_sse2, leanloader_vpass_avx2, leanloader_vpass_avx2};
+
+// rounds a row of premultiplied floats back to PARGB pixels
+static void leanloader_shrink(u32* out, float* in, u32 n) {
+    for (u32 i = 0; i < n; i++) {
+        u32 c[4];
+        for (u32 k = 0; k < 4; k++) {
+            float v = in[i * 4 + k] + 0.5f;
+            c[k] = v <= 0 ? 0 : v >= 255 ? 255 : (u32)v;
+        }
+        // lanczos rings, and a color brighter than its alpha isn't premultiplied anymore
+        for (u32 k = 0; k < 3; k++)
+            if (c[k] > c[3])
+                c[k] = c[3];
+        out[i] = c[3] << 24 | c[2] << 16 | c[1] << 8 | c[0];
+    }
+}
+
+// loads the image named in info resized to w x h with filter (LEANLOADER_FILTER_*); pass 0
+// for one of them to keep the aspect ratio. the image is resampled as it's decoded, from
+// the same rows leanloader_load_rows would deliver, so the full size image is never in
+// memory, only a few rows of it. dst, formats and mips work as in leanloader_load, except
+// for the GDI+-only ARGB64. the struct is then disposed of as usual.
+i32 leanloader_load_scaled(leanloader_image_info* info, u32 w, u32 h, u32 filter) {
+    u32 GMEM_FIXED = 0x0000;
+    leanloader_reset(info);
+    u32 format = leanloader_format(info);
+    if (!leanloader_format_native(format)) {
+        info->error = LEANLOADER_ERROR_UNSUPPORTED;
+        return 0;
+    }
+    if ((w == 0 && h == 0) || filter > LEANLOADER_FILTER_LANCZOS3) {
+        info->error = LEANLOADER_ERROR_UNSUPPORTED;
+        return 0;
+    }
+    // the source is always read as ARGB, the output format is our business
+    leanloader_image_info argb = {0};
+    argb.name = info->name;
+    argb.flags = info->flags;
+    argb.maxpixels = info->maxpixels;
+    leanloader_source src;
+    u32 bandrows = 16;
+    if (!leanloader_source_open(&src, &argb, bandrows)) {
+        info->error = argb.error;
+        return 0;
+    }
+    if (w == 0)
+        w = (u32)(((u64)src.w * h + src.h / 2) / src.h);
+    if (h == 0)
+        h = (u32)(((u64)src.h * w + src.w / 2) / src.w);
+    w = w ? w : 1;
+    h = h ? h : 1;
+
+    i32 loaded = 0;
+    leanloader_contrib cx = {0}, cy = {0};
+    u32* band = 0;
+    float* wide = 0;
+    float* ring = 0;
+    float** rows = 0;
+    u32* out = 0;
+    u64 n16 = (u64)w + 15 & ~(u64)15;
+    info->error = LEANLOADER_ERROR_MEMORY;
+    if (!leanloader_contrib_init(&cx, filter, src.w, w) || !leanloader_contrib_init(&cy, filter, src.h, h))
+        goto done;
+    if (bandrows > src.h)
+        bandrows = src.h;
+    u64 bandpitch = (u64)src.w * 4;
+    u64 ringpitch = (u64)w * 4 * sizeof(float);
+    band = env.GlobalAlloc(GMEM_FIXED, bandpitch * bandrows + 64);
+    wide = env.GlobalAlloc(GMEM_FIXED, (u64)src.w * 4 * sizeof(float));
+    ring = env.GlobalAlloc(GMEM_FIXED, ringpitch * cy.taps);
+    rows = env.GlobalAlloc(GMEM_FIXED, (u64)cy.taps * sizeof(float*));
+    // one PARGB row, padded for the unpremultiply kernels that run over whole blocks
+    out = env.GlobalAlloc(GMEM_FIXED, n16 * 4 + (u64)w * 4 * sizeof(float));
+    if (!band || !wide || !ring || !rows || !out || !leanloader_alloc_pixels(info, w, h))
+        goto done;
+    info->error = 0;
+    info->bd.w = w;
+    info->bd.h = h;
+    float* vout = (float*)(out + n16);
+    leanloader_expand_kernel_t expand = leanloader_expand_kernels[env.cpu];
+    leanloader_hpass_kernel_t hpass = leanloader_hpass_kernels[env.cpu];
+    leanloader_vpass_kernel_t vpass = leanloader_vpass_kernels[env.cpu];
+    u32 ty = 0;
+    for (u32 sy = 0; sy < src.h && ty < h; sy += bandrows) {
+        u32 n = src.h - sy < bandrows ? src.h - sy : bandrows;
+        if (!leanloader_source_read(&src, 0, sy, src.w, n, (u8*)band, (i32)bandpitch)) {
+            info->error = leanloader_source_error(&src);
+            goto done;
+        }
+        for (u32 r = 0; r < n; r++) {
+            u32 y = sy + r;
+            expand(wide, (u32*)((u8*)band + bandpitch * r), src.w);
+            hpass((float*)((u8*)ring + ringpitch * (y % cy.taps)), wide, &cx, w);
+            // every target row whose last source row this was
+            while (ty < h && cy.start[ty] + cy.count[ty] == y + 1) {
+                for (u32 k = 0; k < cy.count[ty]; k++)
+                    rows[k] = (float*)((u8*)ring + ringpitch * ((cy.start[ty] + k) % cy.taps));
+                vpass(vout, rows, cy.weight + (u64)ty * cy.taps, cy.count[ty], 0, w * 4);
+                leanloader_shrink(out, vout, w);
+                u8* dst = (u8*)info->bd.ptr + (u64)info->bd.stride * ty;
+                if (format == LEANLOADER_FORMAT_PARGB) {
+                    leanloader_copy(dst, out, (u64)w * 4);
+                } else {
+                    leanloader_unpremultiply_kernels[env.cpu](out, n16);
+                    if (format == LEANLOADER_FORMAT_ARGB)
+                        leanloader_copy(dst, out, (u64)w * 4);
+                    else
+                        leanloader_pack(out, dst, w, format);
+                }
+                leanloader_mips_row(info, ty);
+                ty++;
+            }
+        }
+    }
+    loaded = ty == h;
+done:
+    if (!loaded)
+        leanloader_free_pixels(info);
+    if (cx.start)
+        env.GlobalFree(cx.start);
+    if (cy.start)
+        env.GlobalFree(cy.start);
+    if (band)
+        env.GlobalFree(band);
+    if (wide)
+        env.GlobalFree(wide);
+    if (ring)
+        env.GlobalFree(ring);
+    if (rows)
+        env.GlobalFree(rows);
+    if (out)
+        env.GlobalFree(out);
+    leanloader_source_close(&src);
+    return loaded;
+}
+
+// what GdipGetPropertyItem fills in; value points into the same buffer
+typedef struct {
+    u32 id;
+    u32 length;         // of value, in bytes
+    u16 type;
+    ptr value;
+} PropertyItem;
+
+// opens name with GDI+, once it's been sniffed, and finds its first frame dimension (time
+// for GIFs, pages for TIFFs) and the number of frames along it. images without any count
+// as one frame. error gets a LEANLOADER_ERROR_* on failure.
+static i32 leanloader_frames_open(wchar* name, u64 maxpixels, ptr* bitmap, GUID* dimension, u32* frames, u32* error) {
+    *bitmap = 0;
+    *frames = 1;
+    leanloader_kernel_init();
+    u64 size = 0;
+    u8* view = leanloader_map(name, &size, 0);
+    if (view == 0) {
+        *error = LEANLOADER_ERROR_OPEN;
+        return 0;
+    }
+    *error = leanloader_sniff(view, size, maxpixels);
+    env.UnmapViewOfFile(view);
+    if (*error)
+        return 0;
+    if (!leanloader_env_init()) {
+        *error = LEANLOADER_ERROR_GDIPLUS;
+        return 0;
+    }
+    u32 status = env.GdipCreateBitmapFromFile(name, bitmap);
+    if (status == 0) {
+        u32 dimensions = 0;
+        if (env.GdipImageGetFrameDimensionsCount(*bitmap, &dimensions) == 0 && dimensions > 0 &&
+            env.GdipImageGetFrameDimensionsList(*bitmap, dimension, 1) == 0 &&
+            (env.GdipImageGetFrameCount(*bitmap, dimension, frames) != 0 || *frames == 0))
+            *frames = 1;
+        return 1;
+    }
+    *bitmap = 0;
+    *error = leanloader_gdip_error(status);
+    leanloader_env_deinit();
+    return 0;
+}
+
+// gets the number of frames in an animated GIF or pages in a multi-page TIFF; everything
+// else has one. returns 0 if the file couldn't be opened.
+u32 leanloader_frame_count(wchar* name) {
+    ptr bitmap;
+    GUID dimension;
+    u32 frames;
+    u32 error;
+    if (!leanloader_frames_open(name, 0, &bitmap, &dimension, &frames, &error))
+        return 0;
+    env.GdipDisposeImage(bitmap);
+    leanloader_env_deinit();
+    return frames;
+}
+
+// loads count frames starting at first (count 0 for all the rest) out of the image named in
+// info, through a single GDI+ bitmap, stacked top to bottom in one buffer (info->dst, if set):
+// frame i starts at bd.ptr + bd.stride * (bd.h / frames) * i, and info->frames says how many
+// there are. all of them have to be the size of the first. if delays isn't null, it gets
+// each frame's delay in milliseconds, 0 where the file has none. no mips; the GDI+ bitmap
+// is never kept, so LEANLOADER_DETACHED is implied. dispose of it as usual.
+i32 leanloader_load_frames(leanloader_image_info* info, u32 first, u32 count, u32* delays) {
+    u32 GMEM_FIXED              = 0x0000;
+    u32 PropertyTagFrameDelay   = 0x5100;
+    leanloader_reset(info);
+    if (info->flags & (LEANLOADER_MIPMAPS | LEANLOADER_MIPMAPS_SRGB)) {
+        info->error = LEANLOADER_ERROR_UNSUPPORTED;
+        return 0;
+    }
+    ptr bitmap;
+    GUID dimension;
+    u32 frames;
+    if (!leanloader_frames_open(info->name, info->maxpixels, &bitmap, &dimension, &frames, &info->error))
+        return 0;
+    i32 loaded = 0;
+    u32 w = 0, h = 0;
+    if (count == 0 && first < frames)
+        count = frames - first;
+    if (first >= frames || count > frames - first)
+        info->error = LEANLOADER_ERROR_UNSUPPORTED;
+    else if (env.GdipGetImageWidth(bitmap, &w) != 0 || env.GdipGetImageHeight(bitmap, &h) != 0)
+        info->error = LEANLOADER_ERROR_GDIPLUS;
+    else if ((u64)h * count > 0xffffffff || (info->maxpixels && (u64)w * h * count > info->maxpixels))
+        info->error = LEANLOADER_ERROR_TOO_BIG;
+    else if (leanloader_alloc_pixels(info, w, h * count)) {
+        info->bd.w = w;
+        info->bd.h = h * count;
+        u64 framebytes = (u64)info->bd.stride * h;
+        u32 i = 0;
+        for (; i < count; i++) {
+            u32 fw = 0, fh = 0;
+            if ((frames > 1 && env.GdipImageSelectActiveFrame(bitmap, &dimension, first + i) != 0) ||
+                env.GdipGetImageWidth(bitmap, &fw) != 0 || env.GdipGetImageHeight(bitmap, &fh) != 0) {
+                info->error = LEANLOADER_ERROR_GDIPLUS;
+                break;
+            }
+            if (fw != w || fh != h) {
+                info->error = LEANLOADER_ERROR_UNSUPPORTED;
+                break;
+            }
+            if (!leanloader_gdip_read(bitmap, 0, 0, w, h, (u8*)info->bd.ptr + framebytes * i, info->bd.stride, info->bd.PixelFormat)) {
+                info->error = LEANLOADER_ERROR_GDIPLUS;
+                break;
+            }
+        }
+        loaded = i == count;
+        if (loaded) {
+            info->frames = count;
+        } else {
+            leanloader_free_pixels(info);
+        }
+    }
+    if (loaded && delays) {
+        // a GIF has one 1/100 s delay per frame in a single property
+        u32 size = 0;
+        u32* property = 0;
+        if (env.GdipGetPropertyItemSize(bitmap, PropertyTagFrameDelay, &size) == 0 && size > sizeof(PropertyItem))
+            property = env.GlobalAlloc(GMEM_FIXED, size);
+        PropertyItem* item = (PropertyItem*)property;
+        u32 have = 0;
+        if (property && env.GdipGetPropertyItem(bitmap, PropertyTagFrameDelay, size, item) == 0)
+            have = item->length / 4;
+        for (u32 i = 0; i < count; i++)
+            delays[i] = first + i < have ? ((u32*)item->value)[first + i] * 10 : 0;
+        if (property)
+            env.GlobalFree(property);
+    }
+    env.GdipDisposeImage(bitmap);
+    leanloader_env_deinit();
+    return loaded;
+}
+
+// what the batch workers share
+typedef struct {
+    leanloader_image_info* infos;
+    i32* status;
+    u32* order;         // indices into infos, biggest file first; 0 to go in array order
+    u32 count;
+    u32 next;           // the next slot in order to hand out, bumped with interlocked ops
+    u32 loaded;
+} leanloader_batch;
+
+// threads just keep grabbing the next image until there are none left, so the big files
+// (which go first) end up spread over all of them, and the small ones fill in the gaps
+static u32 leanloader_batch_worker(ptr param) {
+    leanloader_batch* batch = param;
+    for (;;) {
+        u32 i = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+        if (i >= batch->count)
+            break;
+        u32 index = batch->order ? batch->order[i] : i;
+        i32 result = leanloader_load(&batch->infos[index]);
+        if (batch->status)
+            batch->status[index] = result;
+        if (result)
+            __atomic_add_fetch(&batch->loaded, 1, __ATOMIC_RELAXED);
+    }
+    return 0;
+}
+
+// sorts the indices by file size, biggest first. a heapsort, so no recursion and no extra memory.
+static void leanloader_batch_sort(u32* order, u64* sizes, u32 count) {
+    for (u32 n = count, i = count / 2;;) {
+        u32 root;
+        if (i > 0) {
+            root = order[--i];
+        } else {
+            if (--n == 0)
+                break;
+            root = order[n];
+            order[n] = order[0];
+        }
+        // sift down in a min-heap, which leaves the array in descending order
+        u32 parent = i, child = i * 2 + 1;
+        while (child < n) {
+            if (child + 1 < n && sizes[order[child + 1]] < sizes[order[child]])
+                child++;
+            if (sizes[order[child]] < sizes[root]) {
+                order[parent] = order[child];
+                parent = child;
+                child = parent * 2 + 1;
+            } else {
+                break;
+            }
+        }
+        order[parent] = root;
+    }
+}
+
+// loads count images on up to threads threads (0 means one per processor), the calling
+// thread included. status, if not null, receives the leanloader_load result for each image.
+// returns the number of images loaded successfully.
+i32 leanloader_load_batch(leanloader_image_info* infos, u32 count, u32 threads, i32* status) {
+    u32 maxthreads = 64;
+    leanloader_kernel_init();
+    if (threads == 0)
+        threads = env.GetActiveProcessorCount(0xffff);     // ALL_PROCESSOR_GROUPS
+    if (threads > count)
+        threads = count;
+    if (threads > maxthreads)
+        threads = maxthreads;
+    leanloader_batch batch = {infos, status, 0, count, 0, 0};
+    // without the sizes (or the memory to sort them) the images just go in array order
+    u32 GMEM_FIXED = 0x0000;
+    u32 GetFileExInfoStandard = 0;
+    u64* sizes = threads > 1 ? env.GlobalAlloc(GMEM_FIXED, (u64)count * (sizeof(u64) + sizeof(u32))) : 0;
+    if (sizes) {
+        batch.order = (u32*)(sizes + count);
+        for (u32 i = 0; i < count; i++) {
+            WIN32_FILE_ATTRIBUTE_DATA data;
+            sizes[i] = 0;
+            if (env.GetFileAttributesExW(infos[i].name, GetFileExInfoStandard, &data))
+                sizes[i] = (u64)data.sizehigh << 32 | data.sizelow;
+            batch.order[i] = i;
+        }
+        leanloader_batch_sort(batch.order, sizes, count);
+    }
+    ptr handles[64];
+    u32 started = 0;
+    for (u32 i = 1; i < threads; i++) {
+        handles[started] = env.CreateThread(0, 0, leanloader_batch_worker, &batch, 0, 0);
+        if (handles[started])
+            started++;
+    }
+    leanloader_batch_worker(&batch);
+    u32 INFINITE = 0xffffffff;
+    for (u32 i = 0; i < started; i++) {
+        env.WaitForSingleObject(handles[i], INFINITE);
+        env.CloseHandle(handles[i]);
+    }
+    if (sizes)
+        env.GlobalFree(sizes);
+    return (i32)batch.loaded;
+}
+
+// where leanloader_load_atlas put an image
+typedef struct {
+    u32 x;              // in pixels from the top left corner of the atlas
+    u32 y;
+    u32 w;              // both 0 if the image couldn't be loaded, or was wider than the atlas
+    u32 h;
+    float u0;           // the same as texture coordinates, 0..1 across the atlas
+    float v0;
+    float u1;
+    float v1;
+} leanloader_atlas_rect;
+
+// a span of a skyline: the tops of the images placed so far, seen from above
+typedef struct {
+    u32 x;
+    u32 y;
+    u32 w;
+} leanloader_skyline;
+
+// finds the lowest spot (then the leftmost) for a w x h box, and puts it there. the spans
+// cover 0..maxw without gaps, left to right. returns 0 if the box doesn't fit anywhere.
+static i32 leanloader_skyline_place(leanloader_skyline* spans, u32* count, u32 maxw, u32 w, u32 h, u32* x, u32* y) {
+    u32 best = *count, besty = 0xffffffff;
+    for (u32 i = 0; i < *count && spans[i].x + w <= maxw; i++) {
+        // the box rests on the highest span under it
+        u32 top = 0;
+        for (u32 j = i, covered = 0; covered < w; covered += spans[j].w, j++) {
+            if (spans[j].y > top)
+                top = spans[j].y;
+        }
+        if (top < besty && (u64)top + h <= 0xffffffff) {
+            best = i;
+            besty = top;
+        }
+    }
+    if (best == *count)
+        return 0;
+    *x = spans[best].x;
+    *y = besty;
+    // the spans now under the box shrink or go away, and the box becomes a span of its own
+    u32 end = spans[best].x + w, last = best;
+    while (last < *count && spans[last].x + spans[last].w <= end)
+        last++;
+    if (last < *count) {
+        spans[last].w -= end - spans[last].x;
+        spans[last].x = end;
+    }
+    u32 removed = last - best;
+    if (removed == 0) {
+        for (u32 i = *count; i > best; i--)
+            spans[i] = spans[i - 1];
+        (*count)++;
+    } else if (removed > 1) {
+        for (u32 i = best + 1; i + removed - 1 < *count; i++)
+            spans[i] = spans[i + removed - 1];
+        *count -= removed - 1;
+    }
+    spans[best].x = *x;
+    spans[best].y = besty + h;
+    spans[best].w = w;
+    return 1;
+}
+
+// loads the count files in names into one atlas at most maxw pixels wide, described by info
+// like any other image (its flags, format and dst apply; the mip chain, if asked for, is built
+// over the whole atlas.) padding leaves that many transparent pixels between the images.
+// rects gets one entry per file. the images are read tallest first, each straight into its
+// spot. returns how many of them made it in; if none did, there's no atlas to dispose of.
+i32 leanloader_load_atlas(leanloader_image_info* info, wchar** names, u32 count, u32 maxw, u32 padding, leanloader_atlas_rect* rects) {
+    u32 GMEM_FIXED = 0x0000;
+    leanloader_reset(info);
+    leanloader_kernel_init();
+    u32 bytes = leanloader_format_bytes(leanloader_format(info));
+    if (bytes == 0)
+        info->error = LEANLOADER_ERROR_UNSUPPORTED;
+    if (count == 0 || bytes == 0 || maxw == 0)
+        return 0;
+    u64* keys = env.GlobalAlloc(GMEM_FIXED, (u64)count * (sizeof(u64) + sizeof(u32)) + ((u64)count + 1) * sizeof(leanloader_skyline));
+    if (keys == 0)
+        return 0;
+    u32* order = (u32*)(keys + count);
+    leanloader_skyline* spans = (leanloader_skyline*)(order + count);
+    // sizes first, from the headers
+    for (u32 i = 0; i < count; i++) {
+        leanloader_fill(&rects[i], 0, sizeof(leanloader_atlas_rect));
+        u32 w, h;
+        keys[i] = 0;
+        if (leanloader_probe(names[i], &w, &h, 0) && w && h) {
+            rects[i].w = w;
+            rects[i].h = h;
+            keys[i] = (u64)h << 32 | w;
+        }
+        order[i] = i;
+    }
+    leanloader_batch_sort(order, keys, count);
+    // then the packing, tallest first, each box with the padding to its right and below
+    u32 nspans = 1, atlasw = 0, atlash = 0;
+    spans[0].x = 0;
+    spans[0].y = 0;
+    spans[0].w = maxw;
+    for (u32 i = 0; i < count; i++) {
+        leanloader_atlas_rect* r = &rects[order[i]];
+        if (r->w == 0)
+            continue;
+        // narrow formats pad every row out to a multiple of 4 bytes, which mustn't land on
+        // the next image over
+        u64 w = (((u64)r->w * bytes + 3 & ~(u64)3) + bytes - 1) / bytes;
+        u64 boxw = w + padding, boxh = (u64)r->h + padding;
+        if (boxw > maxw || boxh > 0xffffffff ||
+            !leanloader_skyline_place(spans, &nspans, maxw, (u32)boxw, (u32)boxh, &r->x, &r->y)) {
+            r->w = r->h = 0;
+            continue;
+        }
+        if (r->x + w > atlasw)
+            atlasw = r->x + (u32)w;
+        if (r->y + r->h > atlash)
+            atlash = r->y + r->h;
+    }
+    u32 loaded = 0;
+    if (atlasw && atlash && leanloader_alloc_pixels(info, atlasw, atlash)) {
+        info->bd.w = atlasw;
+        info->bd.h = atlash;
+        u8* pixels = info->bd.ptr;
+        u64 stride = (u64)info->bd.stride;
+        u64 size = stride * (atlash - 1) + ((u64)atlasw * bytes + 3 & ~(u64)3);
+        // whatever no image covers stays transparent
+        leanloader_fill(pixels, 0, size);
+        leanloader_image_info image;
+        for (u32 i = 0; i < count; i++) {
+            u32 k = order[i];
+            leanloader_atlas_rect* r = &rects[k];
+            if (r->w == 0)
+                continue;
+            u64 offset = stride * r->y + (u64)r->x * bytes;
+            leanloader_fill(&image, 0, sizeof(image));
+            image.name = names[k];
+            image.flags = (info->flags & LEANLOADER_NO_NATIVE) | LEANLOADER_DETACHED;
+            image.format = info->format;
+            image.dst = pixels + offset;
+            image.dststride = (i32)stride;
+            // just the spot, so an image bigger than its header said fails instead
+            image.dstsize = stride * (r->h - 1) + ((u64)r->w * bytes + 3 & ~(u64)3);
+            if (leanloader_load(&image) && image.bd.w == r->w && image.bd.h == r->h) {
+                loaded++;
+            } else {
+                // a file that changed since it was probed may still have left some of itself
+                // behind, possibly wider and shorter than the spot
+                u32 w = image.bd.ptr && image.bd.w > r->w ? image.bd.w : r->w;
+                if (w > atlasw - r->x)
+                    w = atlasw - r->x;
+                for (u32 y = 0; y < r->h; y++)
+                    leanloader_fill(pixels + offset + stride * y, 0, (u64)w * bytes);
+                r->w = r->h = 0;
+            }
+            leanloader_dispose(&image);
+        }
+        if (loaded) {
+            leanloader_mips_build(info);
+        } else {
+            leanloader_free_pixels(info);
+        }
+    }
+    for (u32 i = 0; i < count; i++) {
+        leanloader_atlas_rect* r = &rects[i];
+        if (loaded && r->w) {
+            r->u0 = (float)r->x / atlasw;
+            r->v0 = (float)r->y / atlash;
+            r->u1 = (float)(r->x + r->w) / atlasw;
+            r->v1 = (float)(r->y + r->h) / atlash;
+        } else {
+            r->x = r->y = r->w = r->h = 0;
+        }
+    }
+    env.GlobalFree(keys);
+    return (i32)loaded;
+}
+
+// called on a thread pool thread when an asynchronous load has finished
+typedef void (*leanloader_callback_t)(leanloader_image_info* info, i32 result, ptr userdata);
+
+// what's behind the handle leanloader_load_async returns
+typedef struct {
+    leanloader_image_info* info;
+    leanloader_callback_t callback;
+    ptr userdata;
+    ptr event;          // manual-reset, signaled once the load and the callback are done
+    i32 result;
+} leanloader_async;
+
+static void leanloader_async_worker(ptr instance, ptr context) {
+    leanloader_async* async = context;
+    async->result = leanloader_load(async->info);
+    if (async->callback)
+        async->callback(async->info, async->result, async->userdata);
+    // the pool signals the event after we've returned, so nobody can free async under us
+    env.SetEventWhenCallbackReturns(instance, async->event);
+}
+
+// starts loading the image on the thread pool. returns a handle to be passed to the
+// leanloader_async_* functions (and eventually leanloader_async_close), or 0 if the load
+// couldn't be queued. the info struct must stay put until the load completes.
+ptr leanloader_load_async(leanloader_image_info* info, leanloader_callback_t callback, ptr userdata) {
+    leanloader_kernel_init();
+    u32 GPTR = 0x0040;
+    leanloader_async* async = env.GlobalAlloc(GPTR, sizeof(leanloader_async));
+    if (async) {
+        async->info = info;
+        async->callback = callback;
+        async->userdata = userdata;
+        async->event = env.CreateEventW(0, 1, 0, 0);
+        if (async->event) {
+            if (env.TrySubmitThreadpoolCallback(leanloader_async_worker, async, 0))
+                return async;
+            env.CloseHandle(async->event);
+        }
+        env.GlobalFree(async);
+    }
+    return 0;
+}
+
+// waits up to milliseconds (0xffffffff for no limit, 0 to poll) for the load to complete.
+// returns -1 if it hasn't yet, otherwise the result of the load.
+i32 leanloader_async_wait(ptr handle, u32 milliseconds) {
+    leanloader_async* async = handle;
+    u32 WAIT_OBJECT_0 = 0;
+    if (env.WaitForSingleObject(async->event, milliseconds) != WAIT_OBJECT_0)
+        return -1;
+    return async->result;
+}
+
+// the event that gets signaled when the load completes, for WaitForMultipleObjects and
+// friends. it belongs to the handle, don't close it.
+ptr leanloader_async_event(ptr handle) {
+    return ((leanloader_async*)handle)->event;
+}
+
+// waits for the load to complete, then frees the handle. the image stays loaded.
+i32 leanloader_async_close(ptr handle) {
+    leanloader_async* async = handle;
+    i32 result = leanloader_async_wait(async, 0xffffffff);
+    env.CloseHandle(async->event);
+    env.GlobalFree(async);
+    return result;
+}
@@ -0,0 +1,430 @@
+// leanloader_bench.c
+// loads a corpus of images over and over and reports where the time goes. build it with
+// the "build leanloader_bench.exe" task (or gcc -O2 -municode), and run it as
+//
+//     leanloader_bench [-n iterations] [-pool megabytes] [-parallel] [-bc1|-bc3|-bc7] [-cpu level] [file ...]
+//
+// -pool turns on the buffer pool with that budget, so repeat loads of a file reuse its
+// pixel buffer and the alloc column shows what that saves. -parallel sets LEANLOADER_PARALLEL
+// on the native loads, which only makes a difference for big PNGs. -bc1, -bc3 and -bc7 have
+// the native loads block compress their output, and the encoder shows up under decode.
+// -cpu caps the kernels at that LEANLOADER_CPU_* level (0 scalar, 1 SSE2, 2 AVX2, 3 AVX-512),
+// to see what each one buys on the same machine.
+//
+// with no files, it writes a corpus of BMPs and PNGs of a few sizes to %TEMP% and uses
+// that, along with test\leanloader.png. the generated PNGs are stored rather than deflated,
+// so they measure the unfilters and conversions, not the huffman decoder; pass real files
+// for that. every file is loaded natively and through GDI+ (LEANLOADER_NO_NATIVE).
+//
+// the kernels are picked at run time either way (the first line says which level), so the
+// x86-64-v3 and native tasks only show what the compiler does with the rest of the code.
+//
+// the phases are timed by wrapping the function pointers in env, so they're exactly what
+// leanloader itself spends in GDI+ and the allocator. "decode" is whatever is left of the
+// load after those, which for the native paths is all of the actual work.
+
+#include "../leanloader.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <wchar.h>
+
+typedef u32 (*QueryPerformanceCounter_t)(i64* count);
+typedef u32 (*QueryPerformanceFrequency_t)(i64* frequency);
+typedef u32 (*GetTempPathW_t)(u32 size, wchar* buffer);
+typedef u32 (*CreateDirectoryW_t)(wchar* name, ptr security);
+
+typedef struct {
+    u32 cb;
+    u32 PageFaultCount;
+    u64 PeakWorkingSetSize;
+    u64 WorkingSetSize;
+    u64 QuotaPeakPagedPoolUsage;
+    u64 QuotaPagedPoolUsage;
+    u64 QuotaPeakNonPagedPoolUsage;
+    u64 QuotaNonPagedPoolUsage;
+    u64 PagefileUsage;
+    u64 PeakPagefileUsage;
+} PROCESS_MEMORY_COUNTERS;
+
+typedef u32 (*GetProcessMemoryInfo_t)(ptr process, PROCESS_MEMORY_COUNTERS* counters, u32 size);
+
+// what gets timed
+#define BENCH_OPEN      0   // GdipCreateBitmapFromFile
+#define BENCH_ALLOC     1   // GlobalAlloc and VirtualAlloc
+#define BENCH_LOCK      2   // GdipBitmapLockBits
+#define BENCH_LOAD      3   // all of leanloader_load
+#define BENCH_DISPOSE   4   // leanloader_dispose
+#define BENCH_PHASES    5
+
+static struct {
+    QueryPerformanceCounter_t   QueryPerformanceCounter;
+    QueryPerformanceFrequency_t QueryPerformanceFrequency;
+    GetTempPathW_t              GetTempPathW;
+    CreateDirectoryW_t          CreateDirectoryW;
+    GetProcessMemoryInfo_t      GetProcessMemoryInfo;
+    double                      ticks;      // per millisecond
+    i64                         time[BENCH_PHASES];
+    // the real functions behind the wrappers
+    GdipCreateBitmapFromFile_t  GdipCreateBitmapFromFile;
+    GdipBitmapLockBits_t        GdipBitmapLockBits;
+    GlobalAlloc_t               GlobalAlloc;
+    VirtualAlloc_t              VirtualAlloc;
+} bench;
+
+static i64 bench_now() {
+    i64 t;
+    bench.QueryPerformanceCounter(&t);
+    return t;
+}
+
+static u32 bench_open(wchar* name, ptr* bitmap) {
+    i64 t = bench_now();
+    u32 status = bench.GdipCreateBitmapFromFile(name, bitmap);
+    bench.time[BENCH_OPEN] += bench_now() - t;
+    return status;
+}
+
+static u32 bench_lock(ptr bitmap, ptr rect, u32 flags, u32 format, ptr data) {
+    i64 t = bench_now();
+    u32 status = bench.GdipBitmapLockBits(bitmap, rect, flags, format, data);
+    bench.time[BENCH_LOCK] += bench_now() - t;
+    return status;
+}
+
+static ptr bench_globalalloc(u32 flags, u64 size) {
+    i64 t = bench_now();
+    ptr p = bench.GlobalAlloc(flags, size);
+    bench.time[BENCH_ALLOC] += bench_now() - t;
+    return p;
+}
+
+static ptr bench_virtualalloc(ptr address, u64 size, u32 type, u32 protect) {
+    i64 t = bench_now();
+    ptr p = bench.VirtualAlloc(address, size, type, protect);
+    bench.time[BENCH_ALLOC] += bench_now() - t;
+    return p;
+}
+
+// GDI+ has to be up (and stay up) before this, or the next startup resolves the real
+// functions into env again
+static void bench_hook() {
+    bench.GdipCreateBitmapFromFile = env.GdipCreateBitmapFromFile;
+    bench.GdipBitmapLockBits = env.GdipBitmapLockBits;
+    bench.GlobalAlloc = env.GlobalAlloc;
+    bench.VirtualAlloc = env.VirtualAlloc;
+    env.GdipCreateBitmapFromFile = bench_open;
+    env.GdipBitmapLockBits = bench_lock;
+    env.GlobalAlloc = bench_globalalloc;
+    env.VirtualAlloc = bench_virtualalloc;
+}
+
+static void bench_unhook() {
+    env.GdipCreateBitmapFromFile = bench.GdipCreateBitmapFromFile;
+    env.GdipBitmapLockBits = bench.GdipBitmapLockBits;
+    env.GlobalAlloc = bench.GlobalAlloc;
+    env.VirtualAlloc = bench.VirtualAlloc;
+}
+
+// the corpus. pixels are a gradient with some noise in it, so neither the filters nor the
+// alpha handling degenerate into something trivial.
+
+static u32 bench_pixel(u32 x, u32 y, u32* seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    u32 n = *seed & 0x0f0f0f;
+    u32 a = (x + y) & 0x80 ? 0xff : (x * 255 / 64 & 0xff);
+    return a << 24 | ((x & 0xff) << 16 | (y & 0xff) << 8 | ((x ^ y) & 0xff)) ^ n;
+}
+
+static i32 bench_write(wchar* name, u8* data, u64 size) {
+    u32 GENERIC_WRITE   = 0x40000000;
+    u32 CREATE_ALWAYS   = 2;
+    ptr file = env.CreateFileW(name, GENERIC_WRITE, 0, 0, CREATE_ALWAYS, 0x80, 0);
+    if (file == (ptr)-1)
+        return 0;
+    u32 written = 0;
+    i32 ok = env.WriteFile(file, data, (u32)size, &written, 0) && written == size;
+    env.CloseHandle(file);
+    return ok;
+}
+
+// BI_BITFIELDS with an alpha mask in a V4 header, or the alpha would count for nothing
+static i32 bench_bmp(wchar* name, u32 w, u32 h) {
+    u32 offset = 128;
+    u64 size = offset + (u64)w * h * 4;
+    u8* file = env.GlobalAlloc(0x0040, size);
+    if (!file)
+        return 0;
+    file[0] = 'B';
+    file[1] = 'M';
+    leanloader_u32u* p = (leanloader_u32u*)(file + 2);
+    p[0] = (u32)size;
+    p[2] = offset;
+    p[3] = 108;             // BITMAPV4HEADER
+    p[4] = w;
+    p[5] = (u32)-(i32)h;    // top-down
+    p[6] = 1 | 32 << 16;    // planes, bits
+    p[7] = 3;               // BI_BITFIELDS
+    p[13] = 0x00ff0000;     // red, green, blue and alpha masks
+    p[14] = 0x0000ff00;
+    p[15] = 0x000000ff;
+    p[16] = 0xff000000;
+    u32 seed = 1;
+    u32* pixels = (u32*)(file + offset);
+    for (u32 y = 0; y < h; y++)
+        for (u32 x = 0; x < w; x++)
+            pixels[(u64)y * w + x] = bench_pixel(x, y, &seed);
+    i32 ok = bench_write(name, file, size);
+    env.GlobalFree(file);
+    return ok;
+}
+
+static u32 bench_crc(u8* p, u64 n, u32 crc) {
+    crc = ~crc;
+    for (u64 i = 0; i < n; i++) {
+        crc ^= p[i];
+        for (u32 k = 0; k < 8; k++)
+            crc = crc >> 1 ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static void bench_be32(u8* p, u32 v) {
+    p[0] = (u8)(v >> 24);
+    p[1] = (u8)(v >> 16);
+    p[2] = (u8)(v >> 8);
+    p[3] = (u8)v;
+}
+
+static u8 bench_paeth(u8 a, u8 b, u8 c) {
+    i32 p = a + b - c;
+    i32 pa = p > a ? p - a : a - p;
+    i32 pb = p > b ? p - b : b - p;
+    i32 pc = p > c ? p - c : c - p;
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// RGBA, 8 bits, every row with the next of the five filters, in stored deflate blocks
+static i32 bench_png(wchar* name, u32 w, u32 h) {
+    u64 rowbytes = (u64)w * 4;
+    u64 raw = (rowbytes + 1) * h;
+    u64 blocks = (raw + 65534) / 65535;
+    u64 size = 8 + 25 + 12 + 2 + blocks * 5 + raw + 4 + 12;
+    u8* file = env.GlobalAlloc(0x0040, size);
+    u8* rows = env.GlobalAlloc(0x0040, rowbytes * 2 + raw);
+    if (!file || !rows) {
+        if (file)
+            env.GlobalFree(file);
+        if (rows)
+            env.GlobalFree(rows);
+        return 0;
+    }
+    u8* prev = rows;
+    u8* cur = rows + rowbytes;
+    u8* filtered = rows + rowbytes * 2;
+    u32 seed = 1;
+    for (u32 y = 0; y < h; y++) {
+        for (u32 x = 0; x < w; x++) {
+            u32 c = bench_pixel(x, y, &seed);
+            cur[x * 4] = (u8)(c >> 16);
+            cur[x * 4 + 1] = (u8)(c >> 8);
+            cur[x * 4 + 2] = (u8)c;
+            cur[x * 4 + 3] = (u8)(c >> 24);
+        }
+        u8 filter = (u8)(y % 5);
+        u8* out = filtered + (rowbytes + 1) * y;
+        *out++ = filter;
+        for (u64 i = 0; i < rowbytes; i++) {
+            u8 a = i >= 4 ? cur[i - 4] : 0;
+            u8 b = y ? prev[i] : 0;
+            u8 c = i >= 4 && y ? prev[i - 4] : 0;
+            u8 pred = filter == 1 ? a : filter == 2 ? b : filter == 3 ? (u8)((a + b) / 2) : filter == 4 ? bench_paeth(a, b, c) : 0;
+            out[i] = (u8)(cur[i] - pred);
+        }
+        u8* t = prev;
+        prev = cur;
+        cur = t;
+    }
+    u8* p = file;
+    u8 signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    leanloader_copy(p, signature, 8);
+    p += 8;
+    bench_be32(p, 13);
+    leanloader_copy(p + 4, "IHDR", 4);
+    bench_be32(p + 8, w);
+    bench_be32(p + 12, h);
+    p[16] = 8;      // bit depth
+    p[17] = 6;      // RGBA
+    p[18] = p[19] = p[20] = 0;
+    bench_be32(p + 21, bench_crc(p + 4, 17, 0));
+    p += 25;
+    u8* idat = p;
+    u64 idatsize = 2 + blocks * 5 + raw + 4;
+    bench_be32(p, (u32)idatsize);
+    leanloader_copy(p + 4, "IDAT", 4);
+    p += 8;
+    *p++ = 0x78;
+    *p++ = 0x01;
+    u32 s1 = 1, s2 = 0;
+    for (u64 i = 0; i < raw; i++) {
+        s1 = (s1 + filtered[i]) % 65521;
+        s2 = (s2 + s1) % 65521;
+    }
+    for (u64 done = 0; done < raw;) {
+        u32 n = raw - done > 65535 ? 65535 : (u32)(raw - done);
+        *p++ = done + n == raw;
+        p[0] = (u8)n;
+        p[1] = (u8)(n >> 8);
+        p[2] = (u8)~n;
+        p[3] = (u8)(~n >> 8);
+        p += 4;
+        leanloader_copy(p, filtered + done, n);
+        p += n;
+        done += n;
+    }
+    bench_be32(p, s2 << 16 | s1);
+    p += 4;
+    bench_be32(p, bench_crc(idat + 4, idatsize + 4, 0));
+    p += 4;
+    bench_be32(p, 0);
+    leanloader_copy(p + 4, "IEND", 4);
+    bench_be32(p + 8, bench_crc(p + 4, 4, 0));
+    i32 ok = bench_write(name, file, size);
+    env.GlobalFree(file);
+    env.GlobalFree(rows);
+    return ok;
+}
+
+#define BENCH_MAX_FILES 64
+
+static wchar bench_names[BENCH_MAX_FILES][520];
+
+// fills bench_names with the generated corpus, returns how many there are
+static u32 bench_corpus() {
+    static u32 sizes[] = {64, 256, 1024, 4096};
+    wchar dir[520];
+    u32 len = bench.GetTempPathW(480, dir);
+    if (len == 0 || len >= 480)
+        return 0;
+    wchar* sub = L"leanloader_bench\\";
+    for (u32 i = 0; sub[i]; i++)
+        dir[len++] = sub[i];
+    dir[len] = 0;
+    bench.CreateDirectoryW(dir, 0);
+    u32 count = 0;
+    for (u32 i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        for (u32 png = 0; png < 2; png++) {
+            wchar* name = bench_names[count];
+            swprintf(name, 520, L"%ls%u.%ls", dir, sizes[i], png ? L"png" : L"bmp");
+            if (png ? bench_png(name, sizes[i], sizes[i]) : bench_bmp(name, sizes[i], sizes[i]))
+                count++;
+            else
+                wprintf(L"couldn't write %ls\n", name);
+        }
+    }
+    swprintf(bench_names[count++], 520, L"test\\leanloader.png");
+    return count;
+}
+
+static void bench_file(wchar* name, u32 iterations, u32 flags, u32 format) {
+    u64 pixels = 0;
+    // one load up front, so the file is in the cache like it will be for the rest
+    leanloader_image_info info = {0};
+    info.name = name;
+    info.flags = flags;
+    info.format = format;
+    if (!leanloader_load(&info)) {
+        wprintf(L"%-48ls couldn't be loaded\n", name);
+        return;
+    }
+    u32 w = info.bd.w, h = info.bd.h;
+    leanloader_dispose(&info);
+    bench_hook();
+    for (u32 i = 0; i < BENCH_PHASES; i++)
+        bench.time[i] = 0;
+    for (u32 n = 0; n < iterations; n++) {
+        i64 t = bench_now();
+        leanloader_load(&info);
+        bench.time[BENCH_LOAD] += bench_now() - t;
+        t = bench_now();
+        leanloader_dispose(&info);
+        bench.time[BENCH_DISPOSE] += bench_now() - t;
+        pixels += (u64)w * h;
+    }
+    bench_unhook();
+    double per = bench.ticks * iterations;
+    double load = bench.time[BENCH_LOAD] / per;
+    double decode = (bench.time[BENCH_LOAD] - bench.time[BENCH_OPEN] - bench.time[BENCH_ALLOC] - bench.time[BENCH_LOCK]) / per;
+    double mps = (double)pixels / 1e6 / (bench.time[BENCH_LOAD] / (bench.ticks * 1000));
+    wprintf(L"%-48ls %5ux%-5u %-6ls %9.3f %9.1f %9.3f %9.3f %9.3f %9.3f %9.3f\n", name, w, h,
+        flags & LEANLOADER_NO_NATIVE ? L"gdi+" : L"native", load, mps,
+        bench.time[BENCH_OPEN] / per, bench.time[BENCH_ALLOC] / per, bench.time[BENCH_LOCK] / per,
+        decode, bench.time[BENCH_DISPOSE] / per);
+}
+
+int wmain(int argc, wchar** argv) {
+    leanloader_kernel_init();
+    bench.QueryPerformanceCounter = env.GetProcAddress(env.kernel32, "QueryPerformanceCounter");
+    bench.QueryPerformanceFrequency = env.GetProcAddress(env.kernel32, "QueryPerformanceFrequency");
+    bench.GetTempPathW = env.GetProcAddress(env.kernel32, "GetTempPathW");
+    bench.CreateDirectoryW = env.GetProcAddress(env.kernel32, "CreateDirectoryW");
+    bench.GetProcessMemoryInfo = env.GetProcAddress(env.kernel32, "K32GetProcessMemoryInfo");
+    i64 frequency;
+    bench.QueryPerformanceFrequency(&frequency);
+    bench.ticks = frequency / 1000.0;
+
+    u32 iterations = 10;
+    u32 flags = 0;
+    u32 format = 0;
+    u32 count = 0;
+    wchar* names[BENCH_MAX_FILES];
+    for (i32 i = 1; i < argc; i++) {
+        if (argv[i][0] == '-' && argv[i][1] == 'n' && i + 1 < argc)
+            iterations = (u32)wcstoul(argv[++i], 0, 10);
+        else if (argv[i][0] == '-' && argv[i][1] == 'p' && argv[i][2] == 'o' && i + 1 < argc)
+            leanloader_pool_budget((u64)wcstoul(argv[++i], 0, 10) << 20);
+        else if (argv[i][0] == '-' && argv[i][1] == 'p' && argv[i][2] == 'a')
+            flags |= LEANLOADER_PARALLEL;
+        else if (argv[i][0] == '-' && argv[i][1] == 'c' && i + 1 < argc) {
+            u32 level = (u32)wcstoul(argv[++i], 0, 10);
+            if (level < env.cpu)
+                env.cpu = level;
+        } else if (argv[i][0] == '-' && argv[i][1] == 'b' && argv[i][2] == 'c')
+            format = argv[i][3] == '1' ? LEANLOADER_FORMAT_BC1 : argv[i][3] == '3' ? LEANLOADER_FORMAT_BC3 : LEANLOADER_FORMAT_BC7;
+        else if (count < BENCH_MAX_FILES)
+            names[count++] = argv[i];
+    }
+    if (iterations == 0)
+        iterations = 1;
+    if (count == 0) {
+        count = bench_corpus();
+        for (u32 i = 0; i < count; i++)
+            names[i] = bench_names[i];
+    }
+
+    // GDI+ startup and shutdown, which is what every load pays without leanloader_init
+    u32 cycles = 10;
+    i64 t = bench_now();
+    for (u32 i = 0; i < cycles; i++) {
+        leanloader_init();
+        leanloader_shutdown();
+    }
+    wprintf(L"env init + shutdown: %.3f ms, cpu level %u, %u iterations\n\n",
+        (bench_now() - t) / (bench.ticks * cycles), env.cpu, iterations);
+
+    // and from here on it stays up, so the wrappers stay in place
+    leanloader_init();
+    wprintf(L"%-48ls %-11ls %-6ls %9ls %9ls %9ls %9ls %9ls %9ls %9ls\n", L"file", L"size", L"path",
+        L"load ms", L"MP/s", L"open", L"alloc", L"lock", L"decode", L"dispose");
+    for (u32 i = 0; i < count; i++) {
+        bench_file(names[i], iterations, flags, format);
+        bench_file(names[i], iterations, LEANLOADER_NO_NATIVE, 0);
+    }
+    leanloader_shutdown();
+
+    PROCESS_MEMORY_COUNTERS memory = {sizeof(PROCESS_MEMORY_COUNTERS)};
+    if (bench.GetProcessMemoryInfo && bench.GetProcessMemoryInfo((ptr)-1, &memory, sizeof(memory)))
+        wprintf(L"\npeak working set: %.1f MB\n", memory.PeakWorkingSetSize / 1048576.0);
+    return 0;
+}
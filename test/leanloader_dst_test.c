@@ -0,0 +1,53 @@
+// leanloader_dst_test.c
+// checks that nothing touches memory past the end of a caller's dst. build it with the
+// "build leanloader_dst_test.exe" task (or gcc -O2 -municode), and run it as
+//
+//     leanloader_dst_test [file ...]
+//
+// (test\leanloader.png with no files.) each file is loaded with LEANLOADER_MIPMAPS into a
+// dst exactly as big as the image and its mips, with a guard region after it, then put
+// through every leanloader_convert op. exits nonzero if any guard byte changed.
+
+#include "../leanloader.c"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+
+#define GUARD_BYTES 256
+
+static u32 dst_test_file(wchar* name) {
+    leanloader_image_info info = {0};
+    info.name = name;
+    info.flags = LEANLOADER_MIPMAPS | LEANLOADER_DETACHED;
+    if (!leanloader_load(&info)) {
+        wprintf(L"%-48ls couldn't be loaded\n", name);
+        return 1;
+    }
+    u64 size = leanloader_image_bytes(&info);
+    leanloader_dispose(&info);
+    u8* buffer = malloc(size + GUARD_BYTES);
+    if (buffer == 0)
+        return 1;
+    memset(buffer + size, 0xa5, GUARD_BYTES);
+    info.dst = buffer;
+    info.dstsize = size;
+    u32 failed = !leanloader_load(&info);
+    failed |= !leanloader_convert(&info, LEANLOADER_CONVERT_PREMULTIPLY | LEANLOADER_CONVERT_LINEAR | LEANLOADER_CONVERT_RGBA);
+    failed |= !leanloader_convert(&info, LEANLOADER_CONVERT_UNPREMULTIPLY | LEANLOADER_CONVERT_FLIP);
+    leanloader_dispose(&info);
+    for (u32 i = 0; i < GUARD_BYTES; i++)
+        failed |= buffer[size + i] != 0xa5;
+    free(buffer);
+    wprintf(L"%-48ls %ls\n", name, failed ? L"FAILED" : L"ok");
+    return failed;
+}
+
+int wmain(int argc, wchar** argv) {
+    u32 failed = 0;
+    if (argc < 2)
+        failed += dst_test_file(L"test\\leanloader.png");
+    for (i32 i = 1; i < argc; i++)
+        failed += dst_test_file(argv[i]);
+    return failed != 0;
+}
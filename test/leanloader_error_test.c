@@ -0,0 +1,105 @@
+// leanloader_error_test.c
+// checks that the rows, scaled, rect and frames loaders turn bad input away with the right
+// error, before anything is decoded. build it with the "build leanloader_error_test.exe"
+// task (or gcc -O2 -municode), and run it as
+//
+//     leanloader_error_test [file ...]
+//
+// (test\leanloader.png with no files; they have to be PNGs or BMPs.) each file is cut off
+// halfway through its pixels (a PNG's first IDAT), which has to come back as
+// LEANLOADER_ERROR_CORRUPT, and loaded whole with maxpixels one pixel short of it, which
+// has to come back as LEANLOADER_ERROR_TOO_BIG. a file of garbage has to be
+// LEANLOADER_ERROR_FORMAT. all with and without LEANLOADER_NO_NATIVE. exits nonzero if any
+// of them loads, or fails some other way.
+
+#include "../leanloader.c"
+#include <stdio.h>
+#include <wchar.h>
+
+#define ERROR_TEST_FILE     "leanloader_error_test.tmp"
+#define ERROR_TEST_NAME     L"leanloader_error_test.tmp"
+
+static i32 error_test_rows(leanloader_image_info* info, u32 y, u32 height, ptr userdata) {
+    (*(u32*)userdata)++;
+    return 1;
+}
+
+// every loader on name has to fail with error, without delivering a single row
+static u32 error_test_expect(wchar* name, u64 maxpixels, u32 error, wchar* what) {
+    u32 failed = 0;
+    for (u32 native = 0; native < 2; native++) {
+        u32 flags = native ? 0 : LEANLOADER_NO_NATIVE;
+        u32 rows = 0;
+        leanloader_image_info info = {0};
+        info.name = name;
+        info.flags = flags;
+        info.maxpixels = maxpixels;
+        failed |= leanloader_load_rows(&info, 16, error_test_rows, &rows) || rows || info.error != error;
+        leanloader_dispose(&info);
+        info.flags = flags;
+        failed |= leanloader_load_scaled(&info, 64, 0, LEANLOADER_FILTER_BILINEAR) || info.error != error;
+        leanloader_dispose(&info);
+        info.flags = flags;
+        failed |= leanloader_load_rect(&info, 0, 0, 16, 16) || info.error != error;
+        leanloader_dispose(&info);
+        info.flags = flags;
+        failed |= leanloader_load_frames(&info, 0, 0, 0) || info.error != error;
+        leanloader_dispose(&info);
+    }
+    wprintf(L"%-48ls %-10ls %ls\n", name, what, failed ? L"FAILED" : L"ok");
+    return failed;
+}
+
+static u32 error_test_write(u8* data, u64 size) {
+    FILE* file = fopen(ERROR_TEST_FILE, "wb");
+    if (file == 0)
+        return 0;
+    u32 written = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && written;
+}
+
+static u32 error_test_file(wchar* name) {
+    u64 size = 0;
+    leanloader_kernel_init();
+    u8* view = leanloader_map(name, &size, 0);
+    u32 w = 0, h = 0;
+    if (view == 0 || !leanloader_probe(name, &w, &h, 0)) {
+        wprintf(L"%-48ls couldn't be read\n", name);
+        if (view)
+            env.UnmapViewOfFile(view);
+        return 1;
+    }
+    u32 failed = 0;
+    // maxpixels 0 would be no limit at all
+    if ((u64)w * h > 1)
+        failed |= error_test_expect(name, (u64)w * h - 1, LEANLOADER_ERROR_TOO_BIG, L"too big");
+    // in the middle of a chunk, so it can't pass for a complete PNG that's just short
+    u64 cut = size / 2;
+    for (u64 chunk = 8; size > 8 && leanloader_get32be(view) == 0x89504e47 && chunk + 12 <= size; ) {
+        u32 len = leanloader_get32be(view + chunk);
+        if (leanloader_get32be(view + chunk + 4) == 0x49444154) {
+            cut = chunk + 8 + len / 2;
+            break;
+        }
+        chunk += (u64)len + 12;
+    }
+    failed |= !error_test_write(view, cut);
+    failed |= error_test_expect(ERROR_TEST_NAME, 0, LEANLOADER_ERROR_CORRUPT, L"cut short");
+    env.UnmapViewOfFile(view);
+    return failed;
+}
+
+int wmain(int argc, wchar** argv) {
+    u32 failed = 0;
+    if (argc < 2)
+        failed += error_test_file(L"test\\leanloader.png");
+    for (i32 i = 1; i < argc; i++)
+        failed += error_test_file(argv[i]);
+    u8 garbage[256];
+    for (u32 i = 0; i < sizeof(garbage); i++)
+        garbage[i] = (u8)(i * 37 + 11);
+    failed += !error_test_write(garbage, sizeof(garbage));
+    failed += error_test_expect(ERROR_TEST_NAME, 0, LEANLOADER_ERROR_FORMAT, L"garbage");
+    remove(ERROR_TEST_FILE);
+    return failed != 0;
+}